@@ -0,0 +1,276 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boid.h"
+#include "flock_kernels.h"
+#include "obstacle_index.h"
+#include "random.h"
+#include "scene.h"
+#include "spatial_grid.h"
+
+// Microbenchmarks of the flock rules, in the style of Google Benchmark. Every
+// benchmark updates the whole flock repeatedly until it has run for at least
+// the minimum time, and reports the time per Boid. They cover flocks of 500 to
+// 100k Boids, two densities (the expected number of neighbors of a Boid) and
+// several obstacle counts:
+//
+//   cohesion, separation, alignment   one rule, through the spatial grid
+//   avoid_obstacles                   through the obstacle index
+//   update                            Boid::update with the reference rules
+//   update_<kernels>                  Boid::update with the fastest kernels
+//   spawn_remove                      removing a random Boid of a Scene and
+//                                     spawning a new one
+//
+// Results are printed as a table and, with --json, written in Google
+// Benchmark's JSON format so that its tools (e.g. compare.py) can track them.
+// Nothing here needs an OpenGL context.
+//
+// Usage: boids_bench [--filter TEXT] [--max-boids N] [--min-time SECONDS] [--json FILE]
+
+namespace {
+	const int boid_counts[] = { 500, 2000, 10000, 50000, 100000 };
+	const float neighbor_counts[] = { 5.0f, 20.0f };
+	const int obstacle_counts[] = { 0, 80, 1000 };
+
+	// Sink for the results of the rules, so the compiler cannot drop them.
+	volatile float sink;
+
+	void consume(const glm::vec3& v) {
+		sink = v.x + v.y + v.z;
+	}
+
+	// Side of the cube over which `boids` Boids must be spread so that each has
+	// `neighbors` flockmates within the neighbor radius on average.
+	float cube_side(int boids, float neighbors) {
+		float r = Boid::neighbor_radius;
+		float sphere = 4.0f / 3.0f * 3.14159265f * r * r * r;
+		return std::cbrt(boids * sphere / neighbors);
+	}
+
+	glm::vec3 random_position(Random& random, float side) {
+		float h = side / 2.0f;
+		return glm::vec3(random.uniform(-h, h), random.uniform(-h, h), random.uniform(-h, h));
+	}
+
+	struct Result {
+		std::string name;
+		unsigned long long iterations;
+		double ns_per_boid;
+	};
+
+	class Runner {
+	public:
+		std::string filter;
+		double min_time = 0.2;
+		std::vector<Result> results;
+
+		// Method that times `pass`, which updates all `boids` Boids once. The
+		// number of passes grows until they take at least the minimum time.
+		void run(const std::string& name, int boids, const std::function<void()>& pass) {
+			if (!filter.empty() && name.find(filter) == std::string::npos) {
+				return;
+			}
+			pass();  // Warm up the caches.
+
+			unsigned long long iterations = 1;
+			double seconds = 0.0;
+			while (true) {
+				auto start = std::chrono::steady_clock::now();
+				for (unsigned long long i = 0; i < iterations; i ++) {
+					pass();
+				}
+				seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (seconds >= min_time || iterations >= (1ull << 30)) {
+					break;
+				}
+				// Aim a little past the minimum time, as Google Benchmark does.
+				double scale = seconds > 0.0 ? 1.4 * min_time / seconds : 10.0;
+				iterations = (unsigned long long) (iterations * (scale < 10.0 ? scale : 10.0)) + 1;
+			}
+
+			Result result;
+			result.name = name;
+			result.iterations = iterations;
+			result.ns_per_boid = 1e9 * seconds / ((double) iterations * boids);
+			results.push_back(result);
+			std::cout << name << "\t" << result.ns_per_boid << "\t" << iterations << std::endl;
+		}
+	};
+
+	// Method that writes the results in the JSON format of Google Benchmark,
+	// with the time per Boid as real and CPU time.
+	bool write_json(const std::string& path, const std::vector<Result>& results) {
+		std::ofstream out(path);
+		if (!out) {
+			return false;
+		}
+		char date[64];
+		std::time_t now = std::time(nullptr);
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+		out << "{\n  \"context\": {\n";
+		out << "    \"date\": \"" << date << "\",\n";
+		out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+		out << "    \"kernels\": \"" << best_kernels().name << "\",\n";
+#ifdef NDEBUG
+		out << "    \"library_build_type\": \"release\"\n";
+#else
+		out << "    \"library_build_type\": \"debug\"\n";
+#endif
+		out << "  },\n  \"benchmarks\": [";
+		for (unsigned int i = 0; i < results.size(); i ++) {
+			out << (i > 0 ? ",\n" : "\n");
+			out << "    {\"name\": \"" << results[i].name << "\", \"run_type\": \"iteration\""
+			    << ", \"iterations\": " << results[i].iterations
+			    << ", \"real_time\": " << results[i].ns_per_boid
+			    << ", \"cpu_time\": " << results[i].ns_per_boid
+			    << ", \"time_unit\": \"ns\"}";
+		}
+		out << "\n  ]\n}\n";
+		return (bool) out;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Runner runner;
+	int max_boids = 100000;
+	std::string json_path;
+	for (int i = 1; i < argc; i ++) {
+		std::string arg = argv[i];
+		if (arg == "--filter" && i + 1 < argc) {
+			runner.filter = argv[++ i];
+		} else if (arg == "--max-boids" && i + 1 < argc) {
+			max_boids = std::atoi(argv[++ i]);
+		} else if (arg == "--min-time" && i + 1 < argc) {
+			runner.min_time = std::atof(argv[++ i]);
+		} else if (arg == "--json" && i + 1 < argc) {
+			json_path = argv[++ i];
+		} else {
+			std::cerr << "Usage: " << argv[0]
+			          << " [--filter TEXT] [--max-boids N] [--min-time SECONDS] [--json FILE]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	const FlockKernels& kernels = best_kernels();
+	std::cout << "benchmark\tns/boid\titerations\n";
+
+	for (int boid_count : boid_counts) {
+		if (boid_count > max_boids) {
+			continue;
+		}
+		for (float neighbor_count : neighbor_counts) {
+			float side = cube_side(boid_count, neighbor_count);
+			std::ostringstream flock_name;
+			flock_name << "/boids:" << boid_count << "/neighbors:" << neighbor_count;
+
+			FlockStorage flock;
+			flock.reserve(boid_count);
+			for (int i = 0; i < boid_count; i ++) {
+				Random random(1, Random::stream(kBoidStream, i));
+				glm::vec3 p = random_position(random, side);
+				Boid::spawn(flock, p.x, p.y, p.z, random);
+			}
+			FlockStorage next = flock;
+
+			SpatialGrid grid(Boid::neighbor_radius);
+			grid.rebuild(flock.size(), [&](unsigned int i) { return flock.position[i]; });
+			NeighborArrays neighbors;
+			neighbors.gather(flock, &grid);
+
+			runner.run("cohesion" + flock_name.str(), boid_count, [&]() {
+				for (unsigned int i = 0; i < flock.size(); i ++) {
+					consume(Boid(flock, i).cohesion(&grid));
+				}
+			});
+			runner.run("separation" + flock_name.str(), boid_count, [&]() {
+				for (unsigned int i = 0; i < flock.size(); i ++) {
+					consume(Boid(flock, i).separation(&grid));
+				}
+			});
+			runner.run("alignment" + flock_name.str(), boid_count, [&]() {
+				for (unsigned int i = 0; i < flock.size(); i ++) {
+					consume(Boid(flock, i).alignment(&grid));
+				}
+			});
+
+			for (int obstacle_count : obstacle_counts) {
+				std::ostringstream name;
+				name << flock_name.str() << "/obstacles:" << obstacle_count;
+
+				// Obstacles are spread over the same cube as the flock.
+				std::deque<Obstacle> obstacle_storage;
+				std::vector<Obstacle*> obstacles;
+				std::vector<glm::vec4> obstacles_vertices;
+				std::vector<glm::uvec3> obstacles_faces;
+				for (int i = 0; i < obstacle_count; i ++) {
+					Random random(1, Random::stream(kObstacleStream, i));
+					glm::vec3 p = random_position(random, side);
+					obstacle_storage.emplace_back(p.x, p.y, p.z, obstacles_vertices, obstacles_faces, random);
+					obstacles.push_back(&obstacle_storage.back());
+				}
+				ObstacleArrays obstacle_arrays;
+				obstacle_arrays.sync(obstacles);
+				ObstacleIndex obstacle_index;
+				obstacle_index.sync(obstacles);
+
+				runner.run("avoid_obstacles" + name.str(), boid_count, [&]() {
+					for (unsigned int i = 0; i < flock.size(); i ++) {
+						consume(Boid(flock, i).avoid_obstacles(obstacles, &obstacle_index));
+					}
+				});
+				runner.run("update" + name.str(), boid_count, [&]() {
+					for (unsigned int i = 0; i < flock.size(); i ++) {
+						Boid(flock, i).update(next, obstacles, &grid, &obstacle_index);
+					}
+				});
+				runner.run(std::string("update_") + kernels.name + name.str(), boid_count, [&]() {
+					for (unsigned int i = 0; i < flock.size(); i ++) {
+						Boid(flock, i).update(next, kernels, neighbors, obstacle_arrays, &grid, &obstacle_index);
+					}
+				});
+			}
+		}
+	}
+
+	// Churn of a scene's entity store: the flock keeps its size while every
+	// Boid is replaced, as when agents despawn and spawn continuously.
+	for (int boid_count : boid_counts) {
+		if (boid_count > max_boids) {
+			continue;
+		}
+		std::ostringstream name;
+		name << "spawn_remove/boids:" << boid_count;
+
+		Scene scene;
+		scene.populate(boid_count, 0);
+		Random pick(1, Random::stream(kInputStream, 0));
+		runner.run(name.str(), boid_count, [&]() {
+			for (int i = 0; i < boid_count; i ++) {
+				scene.remove_boid(scene.boid_handles.handle(pick.below(scene.boid_handles.size())));
+				scene.add_boid(random_position(pick, 80.0f));
+			}
+		});
+	}
+
+	if (!json_path.empty()) {
+		if (!write_json(json_path, runner.results)) {
+			std::cerr << "Could not write " << json_path << "\n";
+			return EXIT_FAILURE;
+		}
+		std::cout << "Results written to " << json_path << "\n";
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "boid.h"
+#include "flock_kernels.h"
+#include "obstacle_index.h"
+#include "random.h"
+#include "spatial_grid.h"
+
+// Benchmark of the vectorized flock kernels. The steered velocity of every Boid
+// is computed with the reference rules and with each kernel set supported by
+// the CPU, with and without the obstacle index; the time per Boid is reported
+// together with the largest deviation from the reference. Kernels that deviate
+// by more than the tolerance make the program fail.
+//
+// Usage: boids_kernels [boids] [obstacles]
+
+namespace {
+	const float tolerance = 1e-3f;
+
+	glm::vec3 random_position(Random& random, int tam) {
+		return glm::vec3(random.uniform(-tam, tam), random.uniform(-tam, tam), random.uniform(-tam, tam));
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int boid_count = argc > 1 ? std::atoi(argv[1]) : 20000;
+	int obstacle_count = argc > 2 ? std::atoi(argv[2]) : 80;
+
+	int tam = 40;
+	FlockStorage flock;
+	for (int i = 0; i < boid_count; i ++) {
+		Random random(1, Random::stream(kBoidStream, i));
+		glm::vec3 p = random_position(random, tam);
+		Boid::spawn(flock, p.x, p.y, p.z, random);
+	}
+
+	std::vector<Obstacle*> obstacles;
+	std::vector<glm::vec4> obstacles_vertices;
+	std::vector<glm::uvec3> obstacles_faces;
+	for (int i = 0; i < obstacle_count; i ++) {
+		Random random(1, Random::stream(kObstacleStream, i));
+		glm::vec3 p = random_position(random, tam);
+		obstacles.push_back(new Obstacle(p.x, p.y, p.z, obstacles_vertices, obstacles_faces, random));
+	}
+
+	SpatialGrid grid(Boid::neighbor_radius);
+	grid.rebuild(flock.size(), [&](unsigned int i) { return flock.position[i]; });
+
+	NeighborArrays neighbors;
+	neighbors.gather(flock, &grid);
+	ObstacleArrays obstacle_arrays;
+	obstacle_arrays.sync(obstacles);
+	ObstacleIndex obstacle_index;
+	obstacle_index.sync(obstacles);
+
+	// Reference results.
+	std::vector<glm::vec3> expected(flock.size());
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < flock.size(); i ++) {
+		expected[i] = Boid(flock, i).steered_velocity(obstacles, &grid);
+	}
+	double reference_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / flock.size();
+
+	std::cout << "boids: " << boid_count << ", obstacles: " << obstacle_count << "\n";
+	std::cout << "kernels\tns/boid\tmax error\n";
+	std::cout << "reference\t" << reference_ns << "\t0\n";
+
+	// Method that times `steered(i)` over the whole flock and reports its
+	// largest deviation from the reference.
+	bool within_tolerance = true;
+	auto measure = [&](const std::string& name, std::function<glm::vec3(unsigned int)> steered) {
+		std::vector<glm::vec3> actual(flock.size());
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < flock.size(); i ++) {
+			actual[i] = steered(i);
+		}
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / flock.size();
+
+		float max_error = 0.0f;
+		for (unsigned int i = 0; i < flock.size(); i ++) {
+			glm::vec3 difference = actual[i] - expected[i];
+			float error = glm::length(difference) / glm::max(1.0f, glm::length(expected[i]));
+			if (!(error <= max_error)) {
+				max_error = error;
+			}
+		}
+		within_tolerance = within_tolerance && max_error <= tolerance;
+
+		std::cout << name << "\t" << ns << "\t" << max_error << "\n";
+	};
+
+	// Through the obstacle index, the reference rules add the same obstacles in
+	// the same order, so they should not deviate at all.
+	measure("reference+index", [&](unsigned int i) {
+		return Boid(flock, i).steered_velocity(obstacles, &grid, &obstacle_index);
+	});
+
+	std::vector<const FlockKernels*> kernels = available_kernels();
+	for (unsigned int k = 0; k < kernels.size(); k ++) {
+		measure(kernels[k]->name, [&](unsigned int i) {
+			return Boid(flock, i).steered_velocity(*kernels[k], neighbors, obstacle_arrays, &grid);
+		});
+		measure(std::string(kernels[k]->name) + "+index", [&](unsigned int i) {
+			return Boid(flock, i).steered_velocity(*kernels[k], neighbors, obstacle_arrays, &grid, &obstacle_index);
+		});
+	}
+
+	if (!within_tolerance) {
+		std::cerr << "Kernels deviate from the reference rules by more than " << tolerance << "\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "boid.h"
+#include "obstacle.h"
+#include "random.h"
+#include "scene.h"
+
+// Check of the random streams. It fails if the Boid and Obstacle rand_d() or
+// Random::uniform(-1, 1) ever leave [-1, 1) or miss part of that range, if
+// Random::below(n) is biased, if two entities share a stream, or if spawning
+// Boids in bulk gives a different flock with one thread than with several.
+//
+// Usage: boids_random [samples]
+
+namespace {
+	// Method that returns whether the chi-squared statistic of the counts
+	// exceeds what uniform draws give with a probability of about one in a
+	// million.
+	bool biased(const std::vector<uint64_t>& counts, uint64_t samples) {
+		double expected = (double) samples / counts.size();
+		double chi_squared = 0.0;
+		for (uint64_t count : counts) {
+			chi_squared += (count - expected) * (count - expected) / expected;
+		}
+		double degrees = counts.size() - 1;
+		return chi_squared > degrees + 7.0 * std::sqrt(2.0 * degrees);
+	}
+
+	// Method that checks that every value drawn by `draw` lies in [-1, 1), and
+	// that they cover the range evenly.
+	template <typename Draw>
+	bool check_unit_range(const char* name, int samples, Draw draw) {
+		std::vector<uint64_t> counts(20, 0);
+		float low = 1.0f, high = -1.0f;
+		int outside = 0;
+		for (int i = 0; i < samples; i ++) {
+			Random random(i, Random::stream(kBoidStream, i));
+			for (int j = 0; j < 4; j ++) {
+				float x = draw(random);
+				low = x < low ? x : low;
+				high = x > high ? x : high;
+				if (!(x >= -1.0f && x < 1.0f)) {
+					outside ++;
+					continue;
+				}
+				counts[(int) ((x + 1.0f) * 10.0f)] ++;
+			}
+		}
+		bool ok = outside == 0 && !biased(counts, 4 * (uint64_t) samples);
+		std::cout.precision(9);
+		std::cout << name << "\t[" << low << ", " << high << "]\t" << outside << " outside\t"
+		          << (ok ? "ok" : "FAILED") << "\n";
+		std::cout.precision(6);
+		return ok;
+	}
+
+	// Method that checks that below(n) stays below n and hits every value, or
+	// for large n every tenth of the range, equally often.
+	bool check_below(uint32_t n, int samples) {
+		uint32_t bins = n <= 1000 ? n : 10;
+		std::vector<uint64_t> counts(bins, 0);
+		int outside = 0;
+		Random random(7, Random::stream(kInputStream, n));
+		for (int i = 0; i < samples; i ++) {
+			uint32_t x = random.below(n);
+			if (x >= n) {
+				outside ++;
+				continue;
+			}
+			counts[(uint64_t) x * bins / n] ++;
+		}
+		bool ok = outside == 0 && !biased(counts, samples);
+		std::cout << "below(" << n << ")\t" << outside << " outside\t" << (ok ? "ok" : "FAILED") << "\n";
+		return ok;
+	}
+
+	// Method that checks that entities whose indices differ only above the
+	// low 32 bits, or entities of different domains, get different streams.
+	bool check_streams() {
+		const uint64_t indices[] = { 0, 1, 12345, 0xffffffffull };
+		const RandomDomain domains[] = { kBoidStream, kObstacleStream, kInputStream };
+		bool ok = true;
+		for (uint64_t index : indices) {
+			for (RandomDomain domain : domains) {
+				ok = ok && Random::stream(domain, index) != Random::stream(domain, index + (1ull << 32));
+				for (RandomDomain other : domains) {
+					ok = ok && (other == domain || Random::stream(domain, index) != Random::stream(other, index));
+				}
+			}
+		}
+		std::cout << "stream ids\t" << (ok ? "ok" : "FAILED") << "\n";
+		return ok;
+	}
+
+	bool same_flock(const FlockStorage& a, const FlockStorage& b) {
+		return a.size() == b.size() &&
+		       std::memcmp(a.position.data(), b.position.data(), sizeof(glm::vec3) * a.size()) == 0 &&
+		       std::memcmp(a.velocity.data(), b.velocity.data(), sizeof(glm::vec3) * a.size()) == 0 &&
+		       std::memcmp(a.orientation.data(), b.orientation.data(), sizeof(glm::quat) * a.size()) == 0;
+	}
+
+	// Method that checks that scenes with the same seed spawn the same Boids
+	// whatever the number of threads, and that another seed spawns others.
+	bool check_spawn(unsigned int count) {
+		const int thread_counts[] = { 1, 2, 3, 8 };
+		const SpawnRegion regions[] = {
+			SpawnRegion(SpawnRegion::kBox, glm::vec3(0.0f), glm::vec3(40.0f)),
+			SpawnRegion(SpawnRegion::kBall, glm::vec3(3.0f, 4.0f, 5.0f), glm::vec3(10.0f)),
+		};
+
+		bool ok = true;
+		Scene reference;
+		for (int threads : thread_counts) {
+			Scene scene;
+			scene.set_seed(42);
+			scene.simulation.set_threads(threads);
+			for (const SpawnRegion& region : regions) {
+				scene.spawn_boids(count, region);
+			}
+			if (threads == 1) {
+				reference.simulation.flock() = scene.simulation.flock();
+				continue;
+			}
+			bool same = same_flock(reference.simulation.flock(), scene.simulation.flock());
+			std::cout << "spawn_boids, " << threads << " threads\t" << (same ? "ok" : "FAILED") << "\n";
+			ok = ok && same;
+		}
+
+		Scene other;
+		other.set_seed(43);
+		other.simulation.set_threads(1);
+		for (const SpawnRegion& region : regions) {
+			other.spawn_boids(count, region);
+		}
+		bool differs = !same_flock(reference.simulation.flock(), other.simulation.flock());
+		std::cout << "spawn_boids, another seed\t" << (differs ? "ok" : "FAILED") << "\n";
+		return ok && differs;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int samples = argc > 1 ? std::atoi(argv[1]) : 1000000;
+	if (samples < 1000) {
+		std::cerr << "Usage: " << argv[0] << " [samples], with at least 1000 samples\n";
+		return EXIT_FAILURE;
+	}
+
+	bool ok = true;
+	ok = check_unit_range("Boid::rand_d", samples, [](Random& random) { return Boid::rand_d(random); }) && ok;
+	ok = check_unit_range("Obstacle::rand_d", samples, [](Random& random) { return Obstacle::rand_d(random); }) && ok;
+	ok = check_unit_range("uniform(-1, 1)", samples, [](Random& random) { return random.uniform(-1.0f, 1.0f); }) && ok;
+
+	const uint32_t ranges[] = { 1, 2, 3, 7, 10, 1000, 1000000007u, 3u << 30 };
+	for (uint32_t n : ranges) {
+		ok = check_below(n, samples) && ok;
+	}
+
+	ok = check_streams() && ok;
+	ok = check_spawn(samples / 10) && ok;
+
+	if (!ok) {
+		std::cerr << "Random streams failed the check\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "random.h"
+#include "simulation.h"
+
+// Strong-scaling benchmark of the parallel simulation step: the same flock is
+// simulated with 1, 2, 4, 8 and 16 threads, reporting the time per step and the
+// speedup over one thread, followed by the utilization of every worker. Every
+// run must produce exactly the same flock as the single-threaded one; any
+// difference is reported as an error.
+//
+// Usage: boids_scaling [boids] [steps]
+
+namespace {
+	// Method that fills a simulation with `count` boids spread over a cube of side 80.
+	void populate(Simulation& simulation, int count) {
+		int tam = 40;
+		for (int i = 0; i < count; i ++) {
+			Random random(1, Random::stream(kBoidStream, i));
+			float rand_x = random.uniform(-tam, tam);
+			float rand_y = random.uniform(-tam, tam);
+			float rand_z = random.uniform(-tam, tam);
+			Boid::spawn(simulation.flock(), rand_x, rand_y, rand_z, random);
+		}
+	}
+
+	bool same_state(const FlockStorage& a, const FlockStorage& b) {
+		return a.size() == b.size() &&
+		       std::memcmp(a.position.data(), b.position.data(), sizeof(glm::vec3) * a.size()) == 0 &&
+		       std::memcmp(a.velocity.data(), b.velocity.data(), sizeof(glm::vec3) * a.size()) == 0 &&
+		       std::memcmp(a.orientation.data(), b.orientation.data(), sizeof(glm::quat) * a.size()) == 0;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int boids = argc > 1 ? std::atoi(argv[1]) : 10000;
+	int steps = argc > 2 ? std::atoi(argv[2]) : 50;
+	if (boids < 1 || steps < 2) {
+		// The first step only warms up, and the others are timed.
+		std::cerr << "Usage: " << argv[0] << " [boids] [steps], with at least 1 boid and 2 steps\n";
+		return EXIT_FAILURE;
+	}
+	const int thread_counts[] = { 1, 2, 4, 8, 16 };
+
+	std::vector<Obstacle*> obstacles;
+	FlockStorage reference;
+	double serial_seconds = 0.0;
+	bool identical = true;
+	std::ostringstream reports;
+
+	std::cout << "boids: " << boids << ", steps: " << steps << "\n";
+	std::cout << "threads\tms/step\tspeedup\tidentical\n";
+
+	for (int threads : thread_counts) {
+		Simulation simulation;
+		populate(simulation, boids);
+		simulation.set_threads(threads);
+
+		// Warm up so that buffers are allocated before timing.
+		simulation.step(obstacles);
+		simulation.jobs()->reset_stats();
+
+		auto start = std::chrono::steady_clock::now();
+		for (int s = 1; s < steps; s ++) {
+			simulation.step(obstacles);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		bool same = true;
+		if (threads == 1) {
+			reference = simulation.flock();
+			serial_seconds = seconds;
+		} else {
+			same = same_state(reference, simulation.flock());
+			identical = identical && same;
+		}
+
+		std::cout << simulation.thread_count() << "\t"
+		          << 1000.0 * seconds / (steps - 1) << "\t"
+		          << serial_seconds / seconds << "\t"
+		          << (same ? "yes" : "NO") << "\n";
+		reports << "\n" << threads << " threads:\n";
+		simulation.jobs()->report(reports);
+	}
+
+	std::cout << "\nWorker utilization" << reports.str();
+
+	if (!identical) {
+		std::cerr << "Parallel steps diverged from the serial step\n";
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -1,6 +1,5 @@
 FIND_PACKAGE(GLEW REQUIRED)
 INCLUDE_DIRECTORIES(${GLEW_INCLUDE_DIRS})
-LINK_LIBRARIES(${GLEW_LIBRARIES})
 
 FIND_PACKAGE(PkgConfig REQUIRED)
 pkg_search_module(GLFW3 REQUIRED glfw3)
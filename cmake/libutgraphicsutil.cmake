@@ -1,3 +1,4 @@
 AUX_SOURCE_DIRECTORY(${CMAKE_SOURCE_DIR}/lib libutgu_src)
 ADD_LIBRARY(utgraphicsutil SHARED ${libutgu_src})
+target_link_libraries(utgraphicsutil ${OPENGL_gl_LIBRARY} ${GLEW_LIBRARIES})
 list(APPEND stdgl_libraries utgraphicsutil)
@@ -0,0 +1,55 @@
+#include "alloc_counter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+	std::atomic<size_t> allocation_count(0);
+
+	void* counted_malloc(size_t size) {
+		allocation_count.fetch_add(1, std::memory_order_relaxed);
+		void* p = std::malloc(size == 0 ? 1 : size);
+		if (p == nullptr) {
+			throw std::bad_alloc();
+		}
+		return p;
+	}
+}
+
+size_t alloc_counter::allocations() {
+	return allocation_count.load(std::memory_order_relaxed);
+}
+
+// Replacements of the global allocation functions. The array and nothrow forms
+// are routed through the same counter.
+void* operator new(size_t size) {
+	return counted_malloc(size);
+}
+
+void* operator new[](size_t size) {
+	return counted_malloc(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return counted_malloc(size);
+	} catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return counted_malloc(size);
+	} catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
@@ -0,0 +1,13 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstddef>
+
+// Counter of heap allocations made through the global operator new. It is used
+// to check that a tick of the simulation loop does not allocate.
+namespace alloc_counter {
+	// Total number of allocations since the program started.
+	size_t allocations();
+}
+
+#endif
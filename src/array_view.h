@@ -0,0 +1,33 @@
+#ifndef ARRAY_VIEW_H
+#define ARRAY_VIEW_H
+
+#include <cstddef>
+#include <vector>
+
+// Non-owning, read-only view over a contiguous array (similar to C++20's
+// std::span<const T>). It is two words large and meant to be passed by value,
+// so handing a container down through several calls never copies its elements.
+template <typename T>
+class ArrayView {
+public:
+	ArrayView() : data_(nullptr), size_(0) {}
+	ArrayView(const T* data, size_t size) : data_(data), size_(size) {}
+
+	// Views can be taken of any vector whose elements convert to const T
+	// without a copy, e.g. a std::vector<Boid*> seen as ArrayView<const Boid*>.
+	template <typename U>
+	ArrayView(const std::vector<U>& v) : data_(v.data()), size_(v.size()) {}
+
+	const T& operator[](size_t i) const { return data_[i]; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+
+	const T* begin() const { return data_; }
+	const T* end() const { return data_ + size_; }
+
+private:
+	const T* data_;
+	size_t size_;
+};
+
+#endif
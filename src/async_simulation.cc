@@ -0,0 +1,260 @@
+#include "async_simulation.h"
+#include <algorithm>
+#include <iostream>
+#include "alloc_counter.h"
+#include "profiler.h"
+
+void FlockSnapshot::interpolate(float alpha, BoidInstance* instances) const
+{
+	for (unsigned int i = 0; i < current.size(); i ++) {
+		if (i < previous.size()) {
+			instances[i].position = glm::mix(previous[i].position, current[i].position, alpha);
+			instances[i].orientation = glm::slerp(previous[i].orientation, current[i].orientation, alpha);
+		} else {
+			instances[i] = current[i];
+		}
+	}
+}
+
+AsyncSimulation::AsyncSimulation(Scene& scene, FixedTimestep& clock) : scene(scene), clock(clock)
+{
+}
+
+AsyncSimulation::~AsyncSimulation()
+{
+	stop();
+}
+
+void AsyncSimulation::start()
+{
+	if (running) {
+		return;
+	}
+	running = true;
+	thread = std::thread(&AsyncSimulation::run, this);
+}
+
+void AsyncSimulation::stop()
+{
+	running = false;
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void AsyncSimulation::post(std::function<void(Scene&)> command)
+{
+	std::lock_guard<std::mutex> lock(commands_mutex);
+	commands.push_back(std::move(command));
+}
+
+const FlockSnapshot& AsyncSimulation::latest()
+{
+	snapshots.acquire();
+	return snapshots.front();
+}
+
+void AsyncSimulation::take_obstacle_geometry(FlatMesh& mesh, DirtyRange& dirty)
+{
+	if (!geometry_pending.load(std::memory_order_acquire)) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(geometry_mutex);
+	unsigned int size = shared_geometry.size();
+	mesh.vertices.resize(size);
+	mesh.normals.resize(size);
+
+	// Ranges marked before the mesh shrank may reach past its end.
+	unsigned int end = shared_dirty.end < size ? shared_dirty.end : size;
+	if (shared_dirty.begin < end) {
+		std::copy(shared_geometry.vertices.begin() + shared_dirty.begin, shared_geometry.vertices.begin() + end,
+		          mesh.vertices.begin() + shared_dirty.begin);
+		std::copy(shared_geometry.normals.begin() + shared_dirty.begin, shared_geometry.normals.begin() + end,
+		          mesh.normals.begin() + shared_dirty.begin);
+		dirty.mark(shared_dirty.begin, end);
+	}
+	shared_dirty.clear();
+	if (dirty.end > size) {
+		dirty.end = size;
+		if (dirty.begin >= dirty.end) {
+			dirty.clear();
+		}
+	}
+	geometry_pending.store(false, std::memory_order_release);
+}
+
+double AsyncSimulation::busy_seconds() const
+{
+	std::lock_guard<std::mutex> lock(busy_mutex);
+	double seconds = finished_busy_seconds;
+	if (ticking) {
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - tick_start).count();
+	}
+	return seconds;
+}
+
+void AsyncSimulation::run()
+{
+	auto last_advance = std::chrono::steady_clock::now();
+	tick_time = last_advance;
+	bool was_overloaded = false;
+	// Size of the flock after the previous ticks. The first ticks create the
+	// job system and grow the buffers, so they are not checked.
+	unsigned int last_flock_size = 0;
+	// Whether commands changed the scene since the previous ticks.
+	bool commands_since_tick = false;
+	bool changed = true;
+
+	while (running) {
+		// Once the flock stops growing, a whole tick of this loop is not
+		// expected to touch the heap: the commands and the obstacle geometry
+		// reuse their buffers, the steps reuse theirs and the obstacles are
+		// handed down as a view, and the snapshots are only resized. The
+		// counter is shared by every thread, so an allocation made by the
+		// render thread at the same time is also reported. The check is
+		// skipped when the loop is expected to allocate: while the profiler
+		// records, when commands change the scene (until the steps after them
+		// have updated the obstacle indices), when a snapshot grows, and when
+		// the render thread posted commands meanwhile, which it may allocate.
+		size_t allocations_before_tick = alloc_counter::allocations();
+		bool may_allocate = g_profiler.enabled();
+
+		// Apply the changes posted by the render thread.
+		ProfileScope commands_scope("commands");
+		{
+			std::lock_guard<std::mutex> lock(commands_mutex);
+			applying.swap(commands);
+		}
+		for (auto& command : applying) {
+			command(scene);
+		}
+		commands_since_tick = commands_since_tick || !applying.empty();
+		may_allocate = may_allocate || commands_since_tick;
+		changed = changed || !applying.empty();
+		applying.clear();
+		commands_scope.stop();
+
+		// Hand the changed obstacle geometry over to the render thread. Only
+		// this thread resizes the shared copy, so its size can be read without
+		// the lock.
+		DirtyRange& dirty = scene.obstacles_flat_dirty;
+		const FlatMesh& flat = scene.obstacles_flat;
+		if (dirty.dirty() || flat.size() != shared_geometry.size()) {
+			std::lock_guard<std::mutex> lock(geometry_mutex);
+			shared_geometry.vertices.resize(flat.size());
+			shared_geometry.normals.resize(flat.size());
+			unsigned int end = dirty.end < flat.size() ? dirty.end : flat.size();
+			if (dirty.begin < end) {
+				std::copy(flat.vertices.begin() + dirty.begin, flat.vertices.begin() + end,
+				          shared_geometry.vertices.begin() + dirty.begin);
+				std::copy(flat.normals.begin() + dirty.begin, flat.normals.begin() + end,
+				          shared_geometry.normals.begin() + dirty.begin);
+				shared_dirty.mark(dirty.begin, end);
+			}
+			dirty.clear();
+			geometry_pending.store(true, std::memory_order_release);
+		}
+
+		// Run the ticks that are due.
+		auto now = std::chrono::steady_clock::now();
+		int ticks = clock.advance(std::chrono::duration<double>(now - last_advance).count());
+		last_advance = now;
+		if (clock.overloaded() && !was_overloaded) {
+			std::cerr << "Simulation cannot keep up with " << clock.tick_rate()
+			          << " ticks per second; dropping ticks\n";
+		}
+		was_overloaded = clock.overloaded();
+
+		if (ticks > 0) {
+			{
+				std::lock_guard<std::mutex> lock(busy_mutex);
+				ticking = true;
+				tick_start = std::chrono::steady_clock::now();
+			}
+
+			for (int tick = 0; tick < ticks; tick ++) {
+				scene.step();
+			}
+			may_allocate = may_allocate || scene.simulation.flock().size() != last_flock_size;
+			last_flock_size = scene.simulation.flock().size();
+			commands_since_tick = false;
+
+			{
+				std::lock_guard<std::mutex> lock(busy_mutex);
+				ticking = false;
+				finished_busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - tick_start).count();
+			}
+
+			// The last tick was reached the leftover fraction of a tick ago.
+			tick_time = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(clock.alpha() * tick_seconds()));
+			changed = true;
+		}
+
+		if (changed) {
+			PROFILE_SCOPE("publish");
+			may_allocate = publish() || may_allocate;
+			changed = false;
+		}
+
+		size_t tick_allocations = alloc_counter::allocations() - allocations_before_tick;
+		{
+			std::lock_guard<std::mutex> lock(commands_mutex);
+			may_allocate = may_allocate || !commands.empty();
+		}
+		if (tick_allocations > 0 && ticks > 0 && !may_allocate) {
+			std::cerr << "Simulation tick performed " << tick_allocations << " heap allocations\n";
+		}
+
+		// Sleep until the next tick is due.
+		std::this_thread::sleep_for(std::chrono::duration<double>((1.0 - clock.alpha()) * tick_seconds()));
+	}
+}
+
+bool AsyncSimulation::publish()
+{
+	const FlockStorage& now = scene.simulation.flock();
+	const FlockStorage& before = scene.simulation.previous_flock();
+	unsigned int stepped = before.size() < now.size() ? before.size() : now.size();
+
+	FlockSnapshot& snapshot = snapshots.back();
+	bool grows = snapshot.previous.capacity() < stepped || snapshot.current.capacity() < now.size();
+	snapshot.previous.resize(stepped);
+	snapshot.current.resize(now.size());
+	for (unsigned int i = 0; i < now.size(); i ++) {
+		snapshot.current[i].position = now.position[i];
+		snapshot.current[i].orientation = now.orientation[i];
+	}
+	for (unsigned int i = 0; i < stepped; i ++) {
+		snapshot.previous[i].position = before.position[i];
+		snapshot.previous[i].orientation = before.orientation[i];
+	}
+	snapshot.tick_time = tick_time;
+	snapshots.publish();
+	return grows;
+}
+
+void OverlapStats::add(double frame, double render, double simulation, double overlapped)
+{
+	frames ++;
+	frame_seconds += frame;
+	render_seconds += render;
+	simulation_seconds += simulation;
+	overlapped_seconds += overlapped;
+}
+
+void OverlapStats::reset()
+{
+	*this = OverlapStats();
+}
+
+void OverlapStats::report(std::ostream& out) const
+{
+	if (frames == 0) {
+		return;
+	}
+	out << "Per frame: " << 1000.0 * frame_seconds / frames << " ms total, "
+	    << 1000.0 * render_seconds / frames << " ms rendering, "
+	    << 1000.0 * simulation_seconds / frames << " ms simulating, "
+	    << 1000.0 * overlapped_seconds / frames << " ms of both at once\n";
+}
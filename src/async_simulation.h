@@ -0,0 +1,128 @@
+#ifndef ASYNC_SIMULATION_H
+#define ASYNC_SIMULATION_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "fixed_timestep.h"
+#include "flat_mesh.h"
+#include "flock_storage.h"
+#include "scene.h"
+#include "triple_buffer.h"
+
+// State of the flock after a tick, as handed from the simulation thread to the
+// render thread.
+struct FlockSnapshot {
+	// Method that writes to `instances` the flock a fraction `alpha` of a tick
+	// after `previous`, interpolating towards `current`.
+	void interpolate(float alpha, BoidInstance* instances) const;
+
+	unsigned int size() const { return current.size(); }
+
+	// State before and after the last tick. Boids spawned since that tick are
+	// only in `current`.
+	std::vector<BoidInstance> previous;
+	std::vector<BoidInstance> current;
+
+	// Time at which the simulated clock reached the last tick.
+	std::chrono::steady_clock::time_point tick_time;
+};
+
+// Runs the simulation of a scene on its own thread, at the tick rate of the
+// given clock, so that simulating tick N+1 overlaps with drawing tick N. After
+// every tick the flock is published to a triple buffer, from which the render
+// thread takes the latest snapshot without locking.
+//
+// Once started, the thread owns the scene: every change to it goes through
+// post() and is applied between ticks. The obstacle geometry changed by those
+// changes is passed back with take_obstacle_geometry().
+class AsyncSimulation {
+public:
+	AsyncSimulation(Scene& scene, FixedTimestep& clock);
+	~AsyncSimulation();
+
+	void start();
+
+	// Method that stops the thread after its current tick and waits for it.
+	void stop();
+
+	// Method that queues a change to the scene, run on the simulation thread
+	// before its next tick.
+	void post(std::function<void(Scene&)> command);
+
+	// Render side: method that returns the latest snapshot of the flock. It
+	// stays valid until the next call.
+	const FlockSnapshot& latest();
+
+	// Render side: method that brings `mesh` up to date with the obstacle
+	// geometry of the scene, resizing it and marking the vertices that changed
+	// since the last call in `dirty`.
+	void take_obstacle_geometry(FlatMesh& mesh, DirtyRange& dirty);
+
+	// Total time the simulation thread spent running ticks, including the one
+	// it is running now. Differences between two calls tell how much it
+	// simulated in between.
+	double busy_seconds() const;
+
+	double tick_seconds() const { return 1.0 / clock.tick_rate(); }
+
+private:
+	void run();
+
+	// Method that publishes the flock to the render thread. Returns whether
+	// the snapshot it filled had to grow.
+	bool publish();
+
+	Scene& scene;
+	FixedTimestep& clock;
+	std::thread thread;
+	std::atomic<bool> running{false};
+
+	TripleBuffer<FlockSnapshot> snapshots;
+	std::chrono::steady_clock::time_point tick_time;
+
+	std::mutex commands_mutex;
+	std::vector<std::function<void(Scene&)>> commands;
+	std::vector<std::function<void(Scene&)>> applying;
+
+	std::mutex geometry_mutex;
+	std::atomic<bool> geometry_pending{false};
+	// Copy of the scene's flat obstacle mesh, and the part of it not yet
+	// taken by the render thread.
+	FlatMesh shared_geometry;
+	DirtyRange shared_dirty;
+
+	mutable std::mutex busy_mutex;
+	double finished_busy_seconds = 0.0;
+	bool ticking = false;
+	std::chrono::steady_clock::time_point tick_start;
+};
+
+// Per-frame accounting of how much the simulation thread overlapped with the
+// render thread, printed with 'h' and on exit.
+class OverlapStats {
+public:
+	// Method that records a frame that took `frame` seconds, of which the render
+	// thread spent `render` working (the rest waiting for the swap). The
+	// simulation ran for `simulation` seconds during the frame, `overlapped`
+	// of them while the render thread was working.
+	void add(double frame, double render, double simulation, double overlapped);
+
+	void reset();
+
+	// Method that prints the mean time per frame of each part.
+	void report(std::ostream& out) const;
+
+private:
+	unsigned long long frames = 0;
+	double frame_seconds = 0.0;
+	double render_seconds = 0.0;
+	double simulation_seconds = 0.0;
+	double overlapped_seconds = 0.0;
+};
+
+#endif
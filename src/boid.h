@@ -6,21 +6,38 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/norm.hpp> 
 #include <vector>
-#include <random>
 #include "obstacle.h"
-
+#include "random.h"
+#include "spatial_grid.h"
+#include "flock_storage.h"
+#include "flock_kernels.h"
+#include "obstacle_index.h"
+
+// A Boid is a handle to one entry of a FlockStorage: its state lives in the
+// flock's arrays, and the flock rules read the neighbors' state from there.
 class Boid {
 public:
-	// Constructor method that creates a new Boid whose center is given by the provided x, y, and z coordinates.
-	// The Boid's vertices and faces are added to the scene.
-	Boid(float x, float y, float z, std::vector<glm::vec4>& vertices, std::vector<glm::uvec3>& faces, int index) {
-		this->index = index;
-		center = glm::vec3(x, y, z);
+	// Constructor method that creates a handle to the Boid stored at the given
+	// index of the flock.
+	Boid(const FlockStorage& flock, unsigned int index) : flock(flock), index(index) {}
+
+	// Method that creates a new Boid whose center is given by the provided x, y, and z coordinates
+	// and appends it to the flock. Its direction is drawn from `random`.
+	static Boid spawn(FlockStorage& flock, float x, float y, float z, Random& random) {
+		glm::vec3 center = glm::vec3(x, y, z);
+		glm::vec3 velocity;
+		glm::quat orientation;
+		random_motion(random, velocity, orientation);
+		return Boid(flock, flock.add(center, velocity, orientation));
+	}
 
+	// Method that draws the initial velocity of a new Boid from `random`, and
+	// computes the orientation that faces it.
+	static void random_motion(Random& random, glm::vec3& velocity, glm::quat& orientation) {
 		// Generate random velocity.
-		velocity = glm::vec3(rand_d(), rand_d(), rand_d());
+		velocity = glm::vec3(rand_d(random), rand_d(random), rand_d(random));
 		velocity = glm::normalize(velocity);
-		front = velocity;
+		glm::vec3 front = velocity;
 		velocity *= 2.0f;
 
 		// Calculate up
@@ -38,22 +55,34 @@ public:
 			v.y = 0.0f;
 			v.z = 1.0f;
 		}
-		up = glm::cross(front, v) / glm::length(glm::cross(front, v));
+		glm::vec3 up = glm::cross(front, v) / glm::length(glm::cross(front, v));
 
 		// Calculate right
-		right = glm::cross(front, up);
+		glm::vec3 right = glm::cross(front, up);
+
+		// The model space axes right (x), up (y) and back (z) map to the Boid's.
+		orientation = glm::normalize(glm::quat_cast(glm::mat3(right, up, -front)));
+	}
 
-		vertex_base_index = vertices.size();
+	// Method that adds the vertices and faces of the Boid mesh, in model space,
+	// to the given arrays. Every Boid is drawn as an instance of this mesh,
+	// rotated by its orientation and moved to its position.
+	static void mesh(std::vector<glm::vec4>& vertices, std::vector<glm::uvec3>& faces) {
+		glm::vec3 right = glm::vec3(1.0f, 0.0f, 0.0f);
+		glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::vec3 front = model_front();
+
+		int vertex_base_index = vertices.size();
 
 		// Add all vertices of boid
-		vertices.push_back(glm::vec4(center - 0.5f * right, 1.0f));
-		vertices.push_back(glm::vec4(center + 0.5f * right, 1.0f));
+		vertices.push_back(glm::vec4(-0.5f * right, 1.0f));
+		vertices.push_back(glm::vec4(0.5f * right, 1.0f));
 
-		vertices.push_back(glm::vec4(center - 0.25f * front, 1.0f));
-		vertices.push_back(glm::vec4(center + 0.75f * front, 1.0f));
+		vertices.push_back(glm::vec4(-0.25f * front, 1.0f));
+		vertices.push_back(glm::vec4(0.75f * front, 1.0f));
 
-		vertices.push_back(glm::vec4(center - 0.25f * up, 1.0f));
-		vertices.push_back(glm::vec4(center + 0.25f * up, 1.0f));
+		vertices.push_back(glm::vec4(-0.25f * up, 1.0f));
+		vertices.push_back(glm::vec4(0.25f * up, 1.0f));
 
 		// Add all faces of boid
 		faces.push_back(glm::uvec3(vertex_base_index,     vertex_base_index + 3, vertex_base_index + 5));
@@ -67,64 +96,123 @@ public:
 		faces.push_back(glm::uvec3(vertex_base_index + 2, vertex_base_index + 1, vertex_base_index + 4));
 	}
 
+	// Direction the Boid mesh points to in model space.
+	static glm::vec3 model_front() {
+		return glm::vec3(0.0f, 0.0f, -1.0f);
+	}
+
+	// Direction the Boid points to.
+	glm::vec3 front() const {
+		return flock.orientation[index] * model_front();
+	}
+
 	// Method that updates the Boid's position and velocity according to the
-	// rules of the flock.
-	void update(std::vector<glm::vec4>& vertices, std::vector<Boid*> boids, std::vector<Obstacle*> obstacles) {
-		// Calculate contributions of all rules.
-		glm::vec3 v1 = cohesion(boids);
-		glm::vec3 v2 = separation(boids);
-		glm::vec3 v3 = alignment(boids);
-		glm::vec3 v4 = avoid_obstacles(obstacles);
+	// rules of the flock. The current state is only read from this Boid's flock;
+	// the new state is written to the same index of `next`, so every Boid of a
+	// step sees the same snapshot of its neighbors regardless of update order.
+	// If a spatial grid built over the flock is provided, neighbors are looked
+	// up through it; otherwise every Boid is scanned. Likewise, obstacles are
+	// looked up through `obstacle_index` if provided (synced with `obstacles`).
+	void update(FlockStorage& next, ObstacleView obstacles, const SpatialGrid* grid = nullptr,
+	            const ObstacleIndex* obstacle_index = nullptr) const {
+		integrate(next, steered_velocity(obstacles, grid, obstacle_index));
+	}
+
+	// Same as above, but the neighbor and obstacle loops run through the given
+	// vectorized kernels over flat copies of the flock (gathered in the grid's
+	// order when a grid is used) and of the obstacles.
+	void update(FlockStorage& next, const FlockKernels& kernels, const NeighborArrays& neighbors,
+	            const ObstacleArrays& obstacles, const SpatialGrid* grid = nullptr,
+	            const ObstacleIndex* obstacle_index = nullptr) const {
+		integrate(next, steered_velocity(kernels, neighbors, obstacles, grid, obstacle_index));
+	}
+
+	// Method that returns the Boid's velocity after adding the contributions
+	// of all the rules (before limiting it).
+	glm::vec3 steered_velocity(ObstacleView obstacles, const SpatialGrid* grid = nullptr,
+	                           const ObstacleIndex* obstacle_index = nullptr) const {
+		// Calculate contributions of all rules. The three flockmate rules are
+		// evaluated together in a single pass over the neighbors.
+		glm::vec3 v1, v2, v3;
+		flock_rules(grid, v1, v2, v3);
+		glm::vec3 v4 = avoid_obstacles(obstacles, obstacle_index);
+		glm::vec3 v5 = bound_position();
+
+		return flock.velocity[index] + v1 + v2 + v3 + v4 + v5;
+	}
+
+	// Same as above, using vectorized kernels.
+	glm::vec3 steered_velocity(const FlockKernels& kernels, const NeighborArrays& neighbors,
+	                           const ObstacleArrays& obstacles, const SpatialGrid* grid = nullptr,
+	                           const ObstacleIndex* obstacle_index = nullptr) const {
+		const glm::vec3& center = flock.position[index];
+
+		FlockSums sums;
+		if (grid != nullptr) {
+			grid->for_each_near_range(center, [&](unsigned int begin, unsigned int end) {
+				kernels.flock(neighbors, begin, end, center, index, sums);
+			});
+		} else {
+			kernels.flock(neighbors, 0, neighbors.size(), center, index, sums);
+		}
+
+		glm::vec3 v1, v2, v3;
+		finish_flock_rules(sums, v1, v2, v3);
+		glm::vec3 v4;
+		if (obstacle_index != nullptr) {
+			unsigned int begin, end;
+			obstacle_index->near_range(center, begin, end);
+			v4 = kernels.obstacles(obstacle_index->arrays(), begin, end, center) * 60.0f;
+		} else {
+			v4 = kernels.obstacles(obstacles, 0, obstacles.size(), center) * 60.0f;
+		}
 		glm::vec3 v5 = bound_position();
 
+		return flock.velocity[index] + v1 + v2 + v3 + v4 + v5;
+	}
+
+	// Method that writes the Boid's next state to `next` given its new velocity.
+	void integrate(FlockStorage& next, glm::vec3 velocity) const {
+		const glm::vec3& center = flock.position[index];
+
 		// Update velocity with contributions.
-		velocity = velocity + v1 + v2 + v3 + v4 + v5;
 		velocity = limit_velocity(velocity); 
 
 		// Get rotation transformation that will move our original velocity
 		// to the new velocity obtained after applying the flock rules.
 		glm::vec3 new_front = glm::normalize(velocity);
-		glm::quat q = rotation_between_vectors(front, new_front);
-
-		// Apply rotation to all vertices in Boid.
-		for (int i = 0; i < 6; i ++) {
-			vertices[vertex_base_index + i] = glm::vec4(center + glm::vec3(q * glm::vec4(glm::vec3(vertices[vertex_base_index + i]) - center, 1.0f)), 1.0f);
-		}
+		glm::quat q = rotation_between_vectors(front(), new_front);
 
-		front = glm::normalize(glm::vec3(q * glm::vec4(front, 1.0f)));
-		up = glm::normalize(glm::vec3(q * glm::vec4(up, 1.0f)));
-		right = glm::normalize(glm::vec3(q * glm::vec4(right, 1.0f)));
+		// Apply rotation to the Boid's orientation.
+		next.orientation[index] = glm::normalize(q * flock.orientation[index]);
 
-		// Apply translation to all vertices in Boid.
-		for (int i = 0; i < 6; i ++) {
-			vertices[vertex_base_index + i] = glm::vec4(glm::vec3(vertices[vertex_base_index + i]) + velocity, 1.0f);
-		}
-
-		center = center + velocity;
+		next.velocity[index] = velocity;
+		next.position[index] = center + velocity;
 	}
 
 	// Forbid boid from going faster than the limit.
-	glm::vec3 limit_velocity(glm::vec3 v) {
-		if (glm::length(v) > velocity_limit) {
-			return velocity_limit * glm::normalize(v);
+	glm::vec3 limit_velocity(glm::vec3 v) const {
+		if (glm::length(v) > flock.velocity_limit) {
+			return flock.velocity_limit * glm::normalize(v);
 		}
 		return v;
 	}
 
 	// Cohesion rule: generate vector that moves Boid towards center of mass of
 	// neighboring flockmates.
-	glm::vec3 cohesion(std::vector<Boid*> boids) {
+	glm::vec3 cohesion(const SpatialGrid* grid = nullptr) const {
+		const glm::vec3& center = flock.position[index];
 		glm::vec3 avg_position = glm::vec3(0.0f, 0.0f, 0.0f);
 		float count = 0.0f;
 
-		// Iterate over list of Boids.
-		for (unsigned int i = 0; i < boids.size(); i ++) {
+		// Iterate over candidate Boids.
+		for_each_candidate(grid, [&](unsigned int i) {
 			// Detect nearby Boids.
-			if (i != index && glm::length((boids[i]->center) - center) < 10.0f) {
+			if (i != index && glm::length(flock.position[i] - center) < neighbor_radius) {
 				count = count + 1.0f;
-				avg_position += boids[i]->center;
+				avg_position += flock.position[i];
 			}
-		}
+		});
 
 		// Get average position of nearby Boids, if any.
 		if (count > 0.0f) {
@@ -137,48 +225,121 @@ public:
 
 	// Separation rule: generate vector that moves Boid away from nearby
 	// flockmates in order to prevent crowding.
-	glm::vec3 separation(std::vector<Boid*> boids) {
+	glm::vec3 separation(const SpatialGrid* grid = nullptr) const {
+		const glm::vec3& center = flock.position[index];
 		glm::vec3 displacement = glm::vec3(0.0f, 0.0f, 0.0f);
 
-		// Iterate over list of Boids.
-		for (unsigned int i = 0; i < boids.size(); i ++) {
-			float d = glm::length((boids[i]->center) - center);
+		// Iterate over candidate Boids.
+		for_each_candidate(grid, [&](unsigned int i) {
+			float d = glm::length(flock.position[i] - center);
 
 			// Detect nearby Boids.
 			if (i != index && d < 2.0f) {
-				glm::vec3 sample = center - (boids[i]->center);
+				glm::vec3 sample = center - flock.position[i];
 				sample /= d;
 				displacement += sample;
 			}
-		}
+		});
 
 		return displacement;
 	}
 
 	// Alignment rule: generate vector that makes the Boid point
 	// towards the average position where nearby flockmates point to.
-	glm::vec3 alignment(std::vector<Boid*> boids) {
+	glm::vec3 alignment(const SpatialGrid* grid = nullptr) const {
+		const glm::vec3& center = flock.position[index];
 		glm::vec3 orientation = glm::vec3(0.0f, 0.0f, 0.0f);
 		float count = 0.0f;
 
-		// Iterate over list of Boids.
-		for (unsigned int i = 0; i < boids.size(); i ++) {
-			float d = glm::length((boids[i]->center) - center);
+		// Iterate over candidate Boids.
+		for_each_candidate(grid, [&](unsigned int i) {
+			float d = glm::length(flock.position[i] - center);
 
 			// Detect nearby Boids and add their velocity.
-			if (i != index && d < 10.0f) {
-				glm::vec3 sample = boids[i]->velocity;
+			if (i != index && d < neighbor_radius) {
+				glm::vec3 sample = flock.velocity[i];
 				sample /= d;
 				orientation += sample;
 			}
-		}
+		});
 
 		return orientation / 50.0f;
 	}
 
+	// Method that evaluates the cohesion (v1), separation (v2) and alignment (v3)
+	// rules in a single pass: every candidate is visited once and its distance
+	// computed once. Each contribution is accumulated in the same order and with
+	// the same operations as the individual rules, so results are identical.
+	void flock_rules(const SpatialGrid* grid, glm::vec3& v1, glm::vec3& v2, glm::vec3& v3) const {
+		const glm::vec3& center = flock.position[index];
+		FlockSums sums;
+
+		// Iterate over candidate Boids.
+		for_each_candidate(grid, [&](unsigned int i) {
+			if (i == index) {
+				return;
+			}
+
+			const glm::vec3& other_center = flock.position[i];
+			float d = glm::length(other_center - center);
+
+			// Cohesion and alignment: nearby Boids.
+			if (d < neighbor_radius) {
+				sums.count = sums.count + 1.0f;
+				sums.avg_position += other_center;
+
+				glm::vec3 sample = flock.velocity[i];
+				sample /= d;
+				sums.orientation += sample;
+			}
+
+			// Separation: Boids that are too close.
+			if (d < 2.0f) {
+				glm::vec3 sample = center - other_center;
+				sample /= d;
+				sums.displacement += sample;
+			}
+		});
+
+		finish_flock_rules(sums, v1, v2, v3);
+	}
+
+	// Method that turns the sums accumulated over the neighbors into the
+	// cohesion (v1), separation (v2) and alignment (v3) contributions.
+	void finish_flock_rules(FlockSums sums, glm::vec3& v1, glm::vec3& v2, glm::vec3& v3) const {
+		const glm::vec3& center = flock.position[index];
+
+		// Get average position of nearby Boids, if any.
+		if (sums.count > 0.0f) {
+			sums.avg_position /= sums.count;
+			v1 = (sums.avg_position - center) / 100.0f;
+		} else {
+			v1 = glm::vec3(0.0f, 0.0f, 0.0f);
+		}
+
+		v2 = sums.displacement;
+		v3 = sums.orientation / 50.0f;
+	}
+
+	// Method that calls `visit(i)` for every Boid that may be a neighbor: the
+	// Boids in the grid cells around this one when a grid is available, or the
+	// whole flock otherwise (brute force).
+	template <typename Visitor>
+	void for_each_candidate(const SpatialGrid* grid, Visitor visit) const {
+		if (grid != nullptr) {
+			grid->for_each_near(flock.position[index], visit);
+			return;
+		}
+
+		for (unsigned int i = 0; i < flock.size(); i ++) {
+			visit(i);
+		}
+	}
+
 	// Bound position rule: restrict Boids to remain within a distance of
 	// 70 units from the origin.
-	glm::vec3 bound_position() {
+	glm::vec3 bound_position() const {
+		const glm::vec3& center = flock.position[index];
 		if (glm::length(center) < 70.0f) {
 			return glm::vec3(0.0f, 0.0f, 0.0f);
 		}
@@ -188,12 +349,14 @@ public:
 
 	// Obstacle avoidance rule: generate vector that makes the Boid move to
 	// a perpendicular direction with respect to an Obstacle's position, in order
-	// to prevent it from crashing into it.
-	glm::vec3 avoid_obstacles(std::vector<Obstacle*> obstacles) {
+	// to prevent it from crashing into it. Only the obstacles near the Boid are
+	// visited when an index over them is provided.
+	glm::vec3 avoid_obstacles(ObstacleView obstacles, const ObstacleIndex* obstacle_index = nullptr) const {
+		const glm::vec3& center = flock.position[index];
 		glm::vec3 displacement = glm::vec3(0.0f, 0.0f, 0.0f);
 
-		// Iterate over list of obstacles.
-		for (unsigned int i = 0; i < obstacles.size(); i ++) {
+		// Iterate over candidate obstacles.
+		auto visit = [&](unsigned int i) {
 			float d = glm::length((obstacles[i]->center) - center);
 			
 			// Detect obstacles that are getting closer.
@@ -212,6 +375,14 @@ public:
 
 				displacement += perpendicular;
 			}
+		};
+
+		if (obstacle_index != nullptr) {
+			obstacle_index->for_each_near(center, visit);
+		} else {
+			for (unsigned int i = 0; i < obstacles.size(); i ++) {
+				visit(i);
+			}
 		}
 
 		return displacement * 60.0f;
@@ -220,7 +391,7 @@ public:
 	// Method that calculates the quaternion that describes the rotation between two vectors.
 	//
 	// Retrieved from: http://www.opengl-tutorial.org/es/intermediate-tutorials/tutorial-17-quaternions/
-	glm::quat rotation_between_vectors(glm::vec3 start, glm::vec3 end){
+	glm::quat rotation_between_vectors(glm::vec3 start, glm::vec3 end) const {
 		start = glm::normalize(start);
 		end = glm::normalize(end);
 
@@ -248,19 +419,16 @@ public:
 	}
 
 	// Custom random function that returns a float between -1 and 1.
-	float rand_d() {
-		return 2.0f * (((double) rand() / (RAND_MAX)) + 1.0) - 1.0f;
+	static float rand_d(Random& random) {
+		return random.uniform(-1.0f, 1.0f);
 	}
 
-	~Boid();
-	float velocity_limit = 0.6f;
+	// Radius within which flockmates are considered neighbors by the cohesion
+	// and alignment rules. Spatial grids over the flock use it as cell size.
+	static constexpr float neighbor_radius = 10.0f;
+
+	const FlockStorage& flock;
 	unsigned int index;
-	int vertex_base_index;
-	glm::vec3 center;
-	glm::vec3 velocity;
-	glm::vec3 front;
-	glm::vec3 up;
-	glm::vec3 right;
 };
 
 #endif
@@ -0,0 +1,169 @@
+#include "checkpoint.h"
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace {
+	const char kMagic[8] = { 'B', 'O', 'I', 'D', 'C', 'K', 'P', '\0' };
+	const uint32_t kVersion = 2;
+
+	static_assert(sizeof(CheckpointHeader) == 72, "CheckpointHeader must have no padding");
+	static_assert(sizeof(CheckpointObstacle) == 56, "CheckpointObstacle must have no padding");
+	static_assert(sizeof(glm::quat) == 4 * sizeof(float), "glm::quat must be four packed floats");
+
+	template <typename T>
+	bool write_array(FILE* file, const std::vector<T>& values) {
+		return std::fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+	}
+
+	template <typename T>
+	bool read_array(FILE* file, std::vector<T>& values, size_t count) {
+		values.resize(count);
+		return std::fread(values.data(), sizeof(T), count, file) == count;
+	}
+}
+
+bool save_checkpoint(const Scene& scene, const std::string& path, std::string& error)
+{
+	const FlockStorage& flock = scene.simulation.flock();
+
+	CheckpointHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.boid_count = flock.size();
+	header.obstacle_count = scene.obstacles.size();
+	header.obstacle_vertex_count = scene.obstacles_vertices.size();
+	header.obstacle_face_count = scene.obstacles_faces.size();
+	header.velocity_limit = flock.velocity_limit;
+	header.seed = scene.seed;
+	header.input_key = scene.input_random.key;
+	header.input_counter = scene.input_random.counter;
+	header.boids_spawned = scene.boids_spawned;
+	header.obstacles_spawned = scene.obstacles_spawned;
+
+	std::vector<CheckpointObstacle> obstacles(scene.obstacles.size());
+	for (unsigned int i = 0; i < obstacles.size(); i ++) {
+		const Obstacle& obstacle = *scene.obstacles[i];
+		obstacles[i].center = obstacle.center;
+		obstacles[i].front = obstacle.front;
+		obstacles[i].up = obstacle.up;
+		obstacles[i].right = obstacle.right;
+		obstacles[i].radius = obstacle.radius;
+		obstacles[i].side = obstacle.side;
+	}
+
+	// Write next to the destination and rename, so that a failed save never
+	// destroys the previous checkpoint.
+	std::string partial = path + ".partial";
+	FILE* file = std::fopen(partial.c_str(), "wb");
+	if (file == nullptr) {
+		error = "cannot create " + partial;
+		return false;
+	}
+	bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+	               write_array(file, flock.position) &&
+	               write_array(file, flock.velocity) &&
+	               write_array(file, flock.orientation) &&
+	               write_array(file, obstacles) &&
+	               write_array(file, scene.obstacles_vertices) &&
+	               write_array(file, scene.obstacles_faces);
+	written = std::fclose(file) == 0 && written;
+	if (!written || std::rename(partial.c_str(), path.c_str()) != 0) {
+		std::remove(partial.c_str());
+		error = "cannot write " + path;
+		return false;
+	}
+	return true;
+}
+
+bool load_checkpoint(Scene& scene, const std::string& path, std::string& error)
+{
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (file == nullptr) {
+		error = "cannot open " + path;
+		return false;
+	}
+
+	// The header tells exactly how large the file must be, so truncated and
+	// foreign files are rejected before anything is allocated.
+	CheckpointHeader header;
+	struct stat status;
+	uint64_t file_size = fstat(fileno(file), &status) == 0 ? status.st_size : 0;
+	error.clear();
+	if (file_size < sizeof(header) || std::fread(&header, sizeof(header), 1, file) != 1 ||
+	    std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+		error = path + " is not a checkpoint file";
+	} else if (header.version != kVersion) {
+		error = path + " has an unsupported version";
+	} else if (file_size != sizeof(header) +
+	                        (uint64_t) header.boid_count * (2 * sizeof(glm::vec3) + sizeof(glm::quat)) +
+	                        (uint64_t) header.obstacle_count * sizeof(CheckpointObstacle) +
+	                        (uint64_t) header.obstacle_vertex_count * sizeof(glm::vec4) +
+	                        (uint64_t) header.obstacle_face_count * sizeof(glm::uvec3)) {
+		error = path + " is truncated or corrupt";
+	} else if (header.obstacle_vertex_count != (uint64_t) header.obstacle_count * Obstacle::kVertexCount ||
+	           header.obstacle_face_count != (uint64_t) header.obstacle_count * Obstacle::kFaceCount) {
+		error = path + " has corrupt obstacle geometry";
+	}
+	if (!error.empty()) {
+		std::fclose(file);
+		return false;
+	}
+
+	// Read into new arrays, which are swapped into the scene once everything
+	// was read, so that a failed restore leaves the scene untouched.
+	FlockStorage flock;
+	std::vector<CheckpointObstacle> obstacles;
+	std::vector<glm::vec4> vertices;
+	std::vector<glm::uvec3> faces;
+	bool read = read_array(file, flock.position, header.boid_count) &&
+	            read_array(file, flock.velocity, header.boid_count) &&
+	            read_array(file, flock.orientation, header.boid_count) &&
+	            read_array(file, obstacles, header.obstacle_count) &&
+	            read_array(file, vertices, header.obstacle_vertex_count) &&
+	            read_array(file, faces, header.obstacle_face_count);
+	std::fclose(file);
+	if (!read) {
+		error = "cannot read " + path;
+		return false;
+	}
+	for (unsigned int f = 0; f < faces.size(); f ++) {
+		if (faces[f].x >= vertices.size() || faces[f].y >= vertices.size() || faces[f].z >= vertices.size()) {
+			error = path + " has corrupt obstacle faces";
+			return false;
+		}
+	}
+
+	FlockStorage& current = scene.simulation.flock();
+	current.position.swap(flock.position);
+	current.velocity.swap(flock.velocity);
+	current.orientation.swap(flock.orientation);
+	current.velocity_limit = header.velocity_limit;
+
+	scene.obstacles.clear();
+	scene.obstacles.reserve(obstacles.size());
+	scene.obstacle_storage.clear();
+	scene.obstacle_storage.resize(obstacles.size());
+	for (unsigned int i = 0; i < obstacles.size(); i ++) {
+		Obstacle& obstacle = scene.obstacle_storage[i];
+		obstacle.center = obstacles[i].center;
+		obstacle.front = obstacles[i].front;
+		obstacle.up = obstacles[i].up;
+		obstacle.right = obstacles[i].right;
+		obstacle.radius = obstacles[i].radius;
+		obstacle.side = obstacles[i].side;
+		scene.obstacles.push_back(&obstacle);
+	}
+	scene.obstacles_vertices.swap(vertices);
+	scene.obstacles_faces.swap(faces);
+
+	scene.seed = header.seed;
+	scene.input_random.key = header.input_key;
+	scene.input_random.counter = header.input_counter;
+	scene.boids_spawned = header.boids_spawned;
+	scene.obstacles_spawned = header.obstacles_spawned;
+
+	scene.rebuild();
+	return true;
+}
@@ -0,0 +1,60 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include "scene.h"
+
+// Checkpoint file: the whole simulated state of a scene, so that a run can be
+// stopped and resumed exactly where it was.
+//
+//   CheckpointHeader
+//   boid positions         glm::vec3  * boid_count
+//   boid velocities        glm::vec3  * boid_count
+//   boid orientations      glm::quat  * boid_count
+//   obstacles              CheckpointObstacle * obstacle_count
+//   obstacle vertices      glm::vec4  * obstacle_vertex_count
+//   obstacle faces         glm::uvec3 * obstacle_face_count
+//
+// Every section is the in-memory layout of the arrays it is restored into, so
+// restoring is one bulk read per array, with no per-entity work. Random
+// streams are keyed by the seed and the number of entities spawned before, so
+// the seed, those numbers and the state of the input stream are the whole
+// random state of the scene. Handles are not saved: a restored scene hands
+// out new ones.
+struct CheckpointHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t boid_count;
+	uint32_t obstacle_count;
+	uint32_t obstacle_vertex_count;
+	uint32_t obstacle_face_count;
+	float velocity_limit;
+	uint64_t seed;
+	uint64_t input_key;
+	uint64_t input_counter;
+	uint64_t boids_spawned;
+	uint64_t obstacles_spawned;
+};
+
+struct CheckpointObstacle {
+	glm::vec3 center;
+	glm::vec3 front;
+	glm::vec3 up;
+	glm::vec3 right;
+	float radius;
+	float side;
+};
+
+// Method that writes the state of the scene to the given file. The file is
+// replaced only once it was completely written. Returns false, with the
+// reason in `error`, if it could not be written.
+bool save_checkpoint(const Scene& scene, const std::string& path, std::string& error);
+
+// Method that replaces the state of the scene with the one saved in the given
+// file. Returns false, with the reason in `error` and the scene unchanged, if
+// the file is not a complete checkpoint.
+bool load_checkpoint(Scene& scene, const std::string& path, std::string& error);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef ENTITY_HANDLES_H
+#define ENTITY_HANDLES_H
+
+#include <cstdint>
+#include <vector>
+
+// Stable reference to an entity stored in a dense array. Removing other
+// entities moves it around the array, but its handle keeps referring to it;
+// once it is removed, the handle becomes invalid and is never valid again.
+struct EntityHandle {
+	uint32_t slot = UINT32_MAX;
+	uint32_t generation = 0;
+};
+
+// Table mapping handles to the index of their entity in a dense array, for
+// arrays that are kept packed by swap-remove: removing entity i moves the last
+// entity into index i. Adding, removing and looking up entities are O(1), and
+// slots freed by removed entities are reused by later ones, so the table does
+// not grow with churn. The table only tracks indices; the caller adds and
+// moves the entities themselves, in the same way.
+class HandleTable {
+public:
+	unsigned int size() const { return dense_slot.size(); }
+
+	// Method that returns the handle of a new entity appended at index size().
+	EntityHandle add() {
+		EntityHandle handle;
+		if (free_slots.empty()) {
+			handle.slot = slot_generation.size();
+			slot_generation.push_back(0);
+			slot_index.push_back(0);
+		} else {
+			handle.slot = free_slots.back();
+			free_slots.pop_back();
+		}
+		handle.generation = slot_generation[handle.slot];
+		slot_index[handle.slot] = dense_slot.size();
+		dense_slot.push_back(handle.slot);
+		return handle;
+	}
+
+	bool valid(EntityHandle handle) const {
+		return handle.slot < slot_generation.size() && slot_generation[handle.slot] == handle.generation;
+	}
+
+	// Method that returns the index of the entity of a valid handle.
+	unsigned int index(EntityHandle handle) const {
+		return slot_index[handle.slot];
+	}
+
+	// Method that returns the handle of the entity at the given index.
+	EntityHandle handle(unsigned int index) const {
+		EntityHandle handle;
+		handle.slot = dense_slot[index];
+		handle.generation = slot_generation[handle.slot];
+		return handle;
+	}
+
+	// Method that removes the entity at the given index, moving the last entity
+	// into its place (unless it was the last one).
+	void remove(unsigned int index) {
+		uint32_t slot = dense_slot[index];
+		uint32_t moved = dense_slot.back();
+		dense_slot[index] = moved;
+		slot_index[moved] = index;
+		dense_slot.pop_back();
+
+		slot_generation[slot] ++;
+		free_slots.push_back(slot);
+	}
+
+	// Method that drops every entity, invalidating their handles, and adds
+	// `count` new ones at indices [0, count).
+	void reset(unsigned int count) {
+		while (!dense_slot.empty()) {
+			remove(dense_slot.size() - 1);
+		}
+		for (unsigned int i = 0; i < count; i ++) {
+			add();
+		}
+	}
+
+private:
+	// Per slot: generation of the handle that refers to it, and index of its
+	// entity.
+	std::vector<uint32_t> slot_generation;
+	std::vector<uint32_t> slot_index;
+
+	// Per entity: slot of its handle.
+	std::vector<uint32_t> dense_slot;
+
+	std::vector<uint32_t> free_slots;
+};
+
+#endif
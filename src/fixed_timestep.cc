@@ -0,0 +1,47 @@
+#include "fixed_timestep.h"
+
+FixedTimestep::FixedTimestep(double tick_rate, int max_substeps)
+{
+	set_tick_rate(tick_rate);
+	this->max_substeps = max_substeps;
+}
+
+void FixedTimestep::set_tick_rate(double tick_rate)
+{
+	tick_seconds = 1.0 / tick_rate;
+}
+
+int FixedTimestep::advance(double seconds)
+{
+	accumulator += seconds;
+	unsigned long due = (unsigned long) (accumulator / tick_seconds);
+	unsigned long ticks = due < (unsigned long) max_substeps ? due : max_substeps;
+
+	// Ticks beyond the limit are dropped rather than carried over, otherwise
+	// the next frame would start even further behind.
+	last_dropped = due - ticks;
+	accumulator -= due * tick_seconds;
+	if (accumulator < 0.0) {
+		accumulator = 0.0;
+	}
+
+	simulated_ticks += ticks;
+	dropped_ticks += last_dropped;
+	if (last_dropped > 0) {
+		overloaded_frames ++;
+	}
+	return ticks;
+}
+
+void FixedTimestep::reset_stats()
+{
+	simulated_ticks = 0;
+	dropped_ticks = 0;
+	overloaded_frames = 0;
+}
+
+void FixedTimestep::report(std::ostream& out) const
+{
+	out << "Ticks at " << tick_rate() << " Hz: " << simulated_ticks << " simulated, "
+	    << dropped_ticks << " dropped in " << overloaded_frames << " overloaded frames\n";
+}
@@ -0,0 +1,53 @@
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+#include <ostream>
+
+// Fixed-timestep clock for the simulation. Real time is accumulated every frame
+// and consumed in ticks of constant length, so the flock moves at the same
+// speed whatever the frame rate: several ticks run on slow frames and none on
+// fast ones. The time left over is the fraction of a tick to interpolate the
+// drawn state by.
+//
+// When ticks take longer to simulate than the time they cover, the backlog
+// grows every frame and the program stops responding (the "spiral of death").
+// At most `max_substeps` ticks run per frame; the rest of the backlog is
+// dropped and counted, so an overloaded simulation slows down instead.
+class FixedTimestep {
+public:
+	FixedTimestep(double tick_rate = 60.0, int max_substeps = 4);
+
+	// Method that sets the number of ticks per second of simulated time, which
+	// must be positive.
+	void set_tick_rate(double tick_rate);
+	double tick_rate() const { return 1.0 / tick_seconds; }
+
+	// Method that adds the given real time and returns the number of ticks to
+	// simulate now.
+	int advance(double seconds);
+
+	// Fraction of a tick elapsed since the last tick, in [0, 1).
+	float alpha() const { return accumulator / tick_seconds; }
+
+	// Whether the last call to advance() dropped ticks.
+	bool overloaded() const { return last_dropped > 0; }
+
+	void reset_stats();
+
+	// Method that prints the number of ticks simulated and dropped since the
+	// last reset.
+	void report(std::ostream& out) const;
+
+	int max_substeps;
+
+private:
+	double tick_seconds;
+	double accumulator = 0.0;
+	unsigned long last_dropped = 0;
+
+	unsigned long long simulated_ticks = 0;
+	unsigned long long dropped_ticks = 0;
+	unsigned long long overloaded_frames = 0;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef FLAT_MESH_H
+#define FLAT_MESH_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Flat-shaded version of an indexed triangle mesh: every face gets its own
+// three vertices, each carrying the face's normal. Shaders can then read the
+// normal as a vertex attribute instead of computing it per triangle.
+class FlatMesh {
+public:
+	unsigned int size() const {
+		return vertices.size();
+	}
+
+	// Method that appends the faces [first_face, faces.size()) of the given
+	// indexed mesh.
+	void append(const std::vector<glm::vec4>& mesh_vertices, const std::vector<glm::uvec3>& faces,
+	            unsigned int first_face = 0) {
+		for (unsigned int f = first_face; f < faces.size(); f ++) {
+			glm::vec3 a = glm::vec3(mesh_vertices[faces[f].x]);
+			glm::vec3 b = glm::vec3(mesh_vertices[faces[f].y]);
+			glm::vec3 c = glm::vec3(mesh_vertices[faces[f].z]);
+			glm::vec4 normal = glm::vec4(glm::normalize(glm::cross(b - a, c - a)), 0.0f);
+
+			vertices.push_back(mesh_vertices[faces[f].x]);
+			vertices.push_back(mesh_vertices[faces[f].y]);
+			vertices.push_back(mesh_vertices[faces[f].z]);
+			for (int i = 0; i < 3; i ++) {
+				normals.push_back(normal);
+			}
+		}
+	}
+
+	std::vector<glm::vec4> vertices;
+	std::vector<glm::vec4> normals;
+};
+
+#endif
@@ -0,0 +1,387 @@
+#include "flock_kernels.h"
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FLOCK_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+void NeighborArrays::gather(const FlockStorage& flock, const SpatialGrid* grid)
+{
+	unsigned int count = flock.size();
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	vx.resize(count);
+	vy.resize(count);
+	vz.resize(count);
+	index.resize(count);
+
+	for (unsigned int s = 0; s < count; s ++) {
+		unsigned int i = grid != nullptr ? grid->order()[s] : s;
+		x[s] = flock.position[i].x;
+		y[s] = flock.position[i].y;
+		z[s] = flock.position[i].z;
+		vx[s] = flock.velocity[i].x;
+		vy[s] = flock.velocity[i].y;
+		vz[s] = flock.velocity[i].z;
+		index[s] = i;
+	}
+}
+
+void ObstacleArrays::sync(ObstacleView obstacles)
+{
+	for (unsigned int i = x.size(); i < obstacles.size(); i ++) {
+		x.push_back(obstacles[i]->center.x);
+		y.push_back(obstacles[i]->center.y);
+		z.push_back(obstacles[i]->center.z);
+		radius.push_back(obstacles[i]->radius);
+	}
+}
+
+void ObstacleArrays::remove(unsigned int i)
+{
+	x[i] = x.back();
+	y[i] = y.back();
+	z[i] = z.back();
+	radius[i] = radius.back();
+	x.pop_back();
+	y.pop_back();
+	z.pop_back();
+	radius.pop_back();
+}
+
+namespace {
+	const float neighbor_radius_squared = 10.0f * 10.0f;
+	const float separation_radius_squared = 2.0f * 2.0f;
+
+	// Flock rules for a single neighbor stored at slot s.
+	inline void flock_neighbor(const NeighborArrays& n, unsigned int s,
+	                           const glm::vec3& center, unsigned int self, FlockSums& sums) {
+		if (n.index[s] == self) {
+			return;
+		}
+
+		float dx = n.x[s] - center.x;
+		float dy = n.y[s] - center.y;
+		float dz = n.z[s] - center.z;
+		float d2 = dx * dx + dy * dy + dz * dz;
+
+		if (d2 < neighbor_radius_squared) {
+			float inverse_d = 1.0f / std::sqrt(d2);
+			sums.count += 1.0f;
+			sums.avg_position += glm::vec3(n.x[s], n.y[s], n.z[s]);
+			sums.orientation += glm::vec3(n.vx[s], n.vy[s], n.vz[s]) * inverse_d;
+
+			if (d2 < separation_radius_squared) {
+				sums.displacement -= glm::vec3(dx, dy, dz) * inverse_d;
+			}
+		}
+	}
+
+	// Obstacle avoidance for a single obstacle stored at slot s.
+	inline void obstacle_single(const ObstacleArrays& o, unsigned int s, const glm::vec3& center, glm::vec3& displacement) {
+		float sx = center.x - o.x[s];
+		float sy = center.y - o.y[s];
+		float sz = center.z - o.z[s];
+		float d2 = sx * sx + sy * sy + sz * sz;
+		float reach = 3.0f * o.radius[s];
+
+		if (d2 < reach * reach) {
+			// Arbitrary perpendicular vector: sample x (1, 0, 0) or sample x (0, 1, 0).
+			glm::vec3 perpendicular;
+			if (sy != 0.0f && sz != 0.0f) {
+				perpendicular = glm::vec3(0.0f, sz, -sy);
+			} else {
+				perpendicular = glm::vec3(-sz, 0.0f, sx);
+			}
+			float scale = 1.0f / (glm::length(perpendicular) * std::sqrt(d2));
+			displacement += perpendicular * scale;
+		}
+	}
+
+	void flock_scalar(const NeighborArrays& neighbors, unsigned int begin, unsigned int end,
+	                  const glm::vec3& center, unsigned int self, FlockSums& sums) {
+		for (unsigned int s = begin; s < end; s ++) {
+			flock_neighbor(neighbors, s, center, self, sums);
+		}
+	}
+
+	glm::vec3 obstacles_scalar(const ObstacleArrays& obstacles, unsigned int begin, unsigned int end,
+	                           const glm::vec3& center) {
+		glm::vec3 displacement = glm::vec3(0.0f, 0.0f, 0.0f);
+		for (unsigned int s = begin; s < end; s ++) {
+			obstacle_single(obstacles, s, center, displacement);
+		}
+		return displacement;
+	}
+
+#ifdef FLOCK_KERNELS_X86
+	// The SIMD kernels are compiled for their instruction set through function
+	// attributes, so the rest of the program keeps the default target and the
+	// kernels are only called after checking that the CPU supports them.
+
+	__attribute__((target("sse2")))
+	inline float horizontal_sum(__m128 v) {
+		__m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+		__m128 sums = _mm_add_ps(v, shuffled);
+		shuffled = _mm_movehl_ps(shuffled, sums);
+		sums = _mm_add_ss(sums, shuffled);
+		return _mm_cvtss_f32(sums);
+	}
+
+	__attribute__((target("sse2")))
+	void flock_sse(const NeighborArrays& n, unsigned int begin, unsigned int end,
+	               const glm::vec3& center, unsigned int self, FlockSums& sums) {
+		const __m128 cx = _mm_set1_ps(center.x);
+		const __m128 cy = _mm_set1_ps(center.y);
+		const __m128 cz = _mm_set1_ps(center.z);
+		const __m128 near_radius = _mm_set1_ps(neighbor_radius_squared);
+		const __m128 close_radius = _mm_set1_ps(separation_radius_squared);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128i self_index = _mm_set1_epi32(self);
+
+		__m128 count = _mm_setzero_ps();
+		__m128 px = _mm_setzero_ps(), py = _mm_setzero_ps(), pz = _mm_setzero_ps();
+		__m128 ox = _mm_setzero_ps(), oy = _mm_setzero_ps(), oz = _mm_setzero_ps();
+		__m128 sx = _mm_setzero_ps(), sy = _mm_setzero_ps(), sz = _mm_setzero_ps();
+
+		unsigned int s = begin;
+		for (; s + 4 <= end; s += 4) {
+			__m128 x = _mm_loadu_ps(&n.x[s]);
+			__m128 y = _mm_loadu_ps(&n.y[s]);
+			__m128 z = _mm_loadu_ps(&n.z[s]);
+			__m128 dx = _mm_sub_ps(x, cx);
+			__m128 dy = _mm_sub_ps(y, cy);
+			__m128 dz = _mm_sub_ps(z, cz);
+			__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+			__m128 is_self = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) &n.index[s]), self_index));
+			__m128 near = _mm_andnot_ps(is_self, _mm_cmplt_ps(d2, near_radius));
+			__m128 close = _mm_and_ps(near, _mm_cmplt_ps(d2, close_radius));
+			if (_mm_movemask_ps(near) == 0) {
+				continue;
+			}
+
+			__m128 inverse_d = _mm_div_ps(one, _mm_sqrt_ps(d2));
+
+			count = _mm_add_ps(count, _mm_and_ps(near, one));
+			px = _mm_add_ps(px, _mm_and_ps(near, x));
+			py = _mm_add_ps(py, _mm_and_ps(near, y));
+			pz = _mm_add_ps(pz, _mm_and_ps(near, z));
+			ox = _mm_add_ps(ox, _mm_and_ps(near, _mm_mul_ps(_mm_loadu_ps(&n.vx[s]), inverse_d)));
+			oy = _mm_add_ps(oy, _mm_and_ps(near, _mm_mul_ps(_mm_loadu_ps(&n.vy[s]), inverse_d)));
+			oz = _mm_add_ps(oz, _mm_and_ps(near, _mm_mul_ps(_mm_loadu_ps(&n.vz[s]), inverse_d)));
+			sx = _mm_sub_ps(sx, _mm_and_ps(close, _mm_mul_ps(dx, inverse_d)));
+			sy = _mm_sub_ps(sy, _mm_and_ps(close, _mm_mul_ps(dy, inverse_d)));
+			sz = _mm_sub_ps(sz, _mm_and_ps(close, _mm_mul_ps(dz, inverse_d)));
+		}
+
+		sums.count += horizontal_sum(count);
+		sums.avg_position += glm::vec3(horizontal_sum(px), horizontal_sum(py), horizontal_sum(pz));
+		sums.orientation += glm::vec3(horizontal_sum(ox), horizontal_sum(oy), horizontal_sum(oz));
+		sums.displacement += glm::vec3(horizontal_sum(sx), horizontal_sum(sy), horizontal_sum(sz));
+
+		for (; s < end; s ++) {
+			flock_neighbor(n, s, center, self, sums);
+		}
+	}
+
+	__attribute__((target("sse2")))
+	glm::vec3 obstacles_sse(const ObstacleArrays& o, unsigned int begin, unsigned int end, const glm::vec3& center) {
+		const __m128 cx = _mm_set1_ps(center.x);
+		const __m128 cy = _mm_set1_ps(center.y);
+		const __m128 cz = _mm_set1_ps(center.z);
+		const __m128 three = _mm_set1_ps(3.0f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		__m128 ax = _mm_setzero_ps(), ay = _mm_setzero_ps(), az = _mm_setzero_ps();
+
+		unsigned int s = begin;
+		for (; s + 4 <= end; s += 4) {
+			__m128 sx = _mm_sub_ps(cx, _mm_loadu_ps(&o.x[s]));
+			__m128 sy = _mm_sub_ps(cy, _mm_loadu_ps(&o.y[s]));
+			__m128 sz = _mm_sub_ps(cz, _mm_loadu_ps(&o.z[s]));
+			__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy)), _mm_mul_ps(sz, sz));
+			__m128 reach = _mm_mul_ps(three, _mm_loadu_ps(&o.radius[s]));
+			__m128 inside = _mm_cmplt_ps(d2, _mm_mul_ps(reach, reach));
+			if (_mm_movemask_ps(inside) == 0) {
+				continue;
+			}
+
+			// Perpendicular is (0, sz, -sy) when sy and sz are non-zero, and
+			// (-sz, 0, sx) otherwise.
+			__m128 use_x = _mm_and_ps(_mm_cmpneq_ps(sy, zero), _mm_cmpneq_ps(sz, zero));
+			__m128 qx = _mm_andnot_ps(use_x, _mm_sub_ps(zero, sz));
+			__m128 qy = _mm_and_ps(use_x, sz);
+			__m128 qz = _mm_or_ps(_mm_and_ps(use_x, _mm_sub_ps(zero, sy)), _mm_andnot_ps(use_x, sx));
+
+			__m128 q2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_mul_ps(qz, qz));
+			__m128 scale = _mm_div_ps(one, _mm_mul_ps(_mm_sqrt_ps(q2), _mm_sqrt_ps(d2)));
+
+			ax = _mm_add_ps(ax, _mm_and_ps(inside, _mm_mul_ps(qx, scale)));
+			ay = _mm_add_ps(ay, _mm_and_ps(inside, _mm_mul_ps(qy, scale)));
+			az = _mm_add_ps(az, _mm_and_ps(inside, _mm_mul_ps(qz, scale)));
+		}
+
+		glm::vec3 displacement = glm::vec3(horizontal_sum(ax), horizontal_sum(ay), horizontal_sum(az));
+		for (; s < end; s ++) {
+			obstacle_single(o, s, center, displacement);
+		}
+		return displacement;
+	}
+
+	__attribute__((target("avx2")))
+	inline float horizontal_sum(__m256 v) {
+		__m128 sums = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		__m128 shuffled = _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(2, 3, 0, 1));
+		sums = _mm_add_ps(sums, shuffled);
+		shuffled = _mm_movehl_ps(shuffled, sums);
+		sums = _mm_add_ss(sums, shuffled);
+		return _mm_cvtss_f32(sums);
+	}
+
+	__attribute__((target("avx2")))
+	void flock_avx2(const NeighborArrays& n, unsigned int begin, unsigned int end,
+	                const glm::vec3& center, unsigned int self, FlockSums& sums) {
+		const __m256 cx = _mm256_set1_ps(center.x);
+		const __m256 cy = _mm256_set1_ps(center.y);
+		const __m256 cz = _mm256_set1_ps(center.z);
+		const __m256 near_radius = _mm256_set1_ps(neighbor_radius_squared);
+		const __m256 close_radius = _mm256_set1_ps(separation_radius_squared);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256i self_index = _mm256_set1_epi32(self);
+
+		__m256 count = _mm256_setzero_ps();
+		__m256 px = _mm256_setzero_ps(), py = _mm256_setzero_ps(), pz = _mm256_setzero_ps();
+		__m256 ox = _mm256_setzero_ps(), oy = _mm256_setzero_ps(), oz = _mm256_setzero_ps();
+		__m256 sx = _mm256_setzero_ps(), sy = _mm256_setzero_ps(), sz = _mm256_setzero_ps();
+
+		unsigned int s = begin;
+		for (; s + 8 <= end; s += 8) {
+			__m256 x = _mm256_loadu_ps(&n.x[s]);
+			__m256 y = _mm256_loadu_ps(&n.y[s]);
+			__m256 z = _mm256_loadu_ps(&n.z[s]);
+			__m256 dx = _mm256_sub_ps(x, cx);
+			__m256 dy = _mm256_sub_ps(y, cy);
+			__m256 dz = _mm256_sub_ps(z, cz);
+			__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+			__m256 is_self = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) &n.index[s]), self_index));
+			__m256 near = _mm256_andnot_ps(is_self, _mm256_cmp_ps(d2, near_radius, _CMP_LT_OQ));
+			__m256 close = _mm256_and_ps(near, _mm256_cmp_ps(d2, close_radius, _CMP_LT_OQ));
+			if (_mm256_movemask_ps(near) == 0) {
+				continue;
+			}
+
+			__m256 inverse_d = _mm256_div_ps(one, _mm256_sqrt_ps(d2));
+
+			count = _mm256_add_ps(count, _mm256_and_ps(near, one));
+			px = _mm256_add_ps(px, _mm256_and_ps(near, x));
+			py = _mm256_add_ps(py, _mm256_and_ps(near, y));
+			pz = _mm256_add_ps(pz, _mm256_and_ps(near, z));
+			ox = _mm256_add_ps(ox, _mm256_and_ps(near, _mm256_mul_ps(_mm256_loadu_ps(&n.vx[s]), inverse_d)));
+			oy = _mm256_add_ps(oy, _mm256_and_ps(near, _mm256_mul_ps(_mm256_loadu_ps(&n.vy[s]), inverse_d)));
+			oz = _mm256_add_ps(oz, _mm256_and_ps(near, _mm256_mul_ps(_mm256_loadu_ps(&n.vz[s]), inverse_d)));
+			sx = _mm256_sub_ps(sx, _mm256_and_ps(close, _mm256_mul_ps(dx, inverse_d)));
+			sy = _mm256_sub_ps(sy, _mm256_and_ps(close, _mm256_mul_ps(dy, inverse_d)));
+			sz = _mm256_sub_ps(sz, _mm256_and_ps(close, _mm256_mul_ps(dz, inverse_d)));
+		}
+
+		sums.count += horizontal_sum(count);
+		sums.avg_position += glm::vec3(horizontal_sum(px), horizontal_sum(py), horizontal_sum(pz));
+		sums.orientation += glm::vec3(horizontal_sum(ox), horizontal_sum(oy), horizontal_sum(oz));
+		sums.displacement += glm::vec3(horizontal_sum(sx), horizontal_sum(sy), horizontal_sum(sz));
+
+		// Finish the remaining (at most seven) neighbors four at a time first.
+		flock_sse(n, s, end, center, self, sums);
+	}
+
+	__attribute__((target("avx2")))
+	glm::vec3 obstacles_avx2(const ObstacleArrays& o, unsigned int begin, unsigned int end, const glm::vec3& center) {
+		const __m256 cx = _mm256_set1_ps(center.x);
+		const __m256 cy = _mm256_set1_ps(center.y);
+		const __m256 cz = _mm256_set1_ps(center.z);
+		const __m256 three = _mm256_set1_ps(3.0f);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+
+		__m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps(), az = _mm256_setzero_ps();
+
+		unsigned int s = begin;
+		for (; s + 8 <= end; s += 8) {
+			__m256 sx = _mm256_sub_ps(cx, _mm256_loadu_ps(&o.x[s]));
+			__m256 sy = _mm256_sub_ps(cy, _mm256_loadu_ps(&o.y[s]));
+			__m256 sz = _mm256_sub_ps(cz, _mm256_loadu_ps(&o.z[s]));
+			__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, sx), _mm256_mul_ps(sy, sy)), _mm256_mul_ps(sz, sz));
+			__m256 reach = _mm256_mul_ps(three, _mm256_loadu_ps(&o.radius[s]));
+			__m256 inside = _mm256_cmp_ps(d2, _mm256_mul_ps(reach, reach), _CMP_LT_OQ);
+			if (_mm256_movemask_ps(inside) == 0) {
+				continue;
+			}
+
+			__m256 use_x = _mm256_and_ps(_mm256_cmp_ps(sy, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(sz, zero, _CMP_NEQ_UQ));
+			__m256 qx = _mm256_andnot_ps(use_x, _mm256_sub_ps(zero, sz));
+			__m256 qy = _mm256_and_ps(use_x, sz);
+			__m256 qz = _mm256_or_ps(_mm256_and_ps(use_x, _mm256_sub_ps(zero, sy)), _mm256_andnot_ps(use_x, sx));
+
+			__m256 q2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(qx, qx), _mm256_mul_ps(qy, qy)), _mm256_mul_ps(qz, qz));
+			__m256 scale = _mm256_div_ps(one, _mm256_mul_ps(_mm256_sqrt_ps(q2), _mm256_sqrt_ps(d2)));
+
+			ax = _mm256_add_ps(ax, _mm256_and_ps(inside, _mm256_mul_ps(qx, scale)));
+			ay = _mm256_add_ps(ay, _mm256_and_ps(inside, _mm256_mul_ps(qy, scale)));
+			az = _mm256_add_ps(az, _mm256_and_ps(inside, _mm256_mul_ps(qz, scale)));
+		}
+
+		glm::vec3 displacement = glm::vec3(horizontal_sum(ax), horizontal_sum(ay), horizontal_sum(az));
+		for (; s < end; s ++) {
+			obstacle_single(o, s, center, displacement);
+		}
+		return displacement;
+	}
+#endif
+
+	const FlockKernels scalar = { "scalar", flock_scalar, obstacles_scalar };
+#ifdef FLOCK_KERNELS_X86
+	const FlockKernels sse = { "sse", flock_sse, obstacles_sse };
+	const FlockKernels avx2 = { "avx2", flock_avx2, obstacles_avx2 };
+#endif
+}
+
+const FlockKernels& scalar_kernels()
+{
+	return scalar;
+}
+
+std::vector<const FlockKernels*> available_kernels()
+{
+	std::vector<const FlockKernels*> kernels;
+	kernels.push_back(&scalar);
+#ifdef FLOCK_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		kernels.push_back(&sse);
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		kernels.push_back(&avx2);
+	}
+#endif
+	return kernels;
+}
+
+const FlockKernels& best_kernels()
+{
+	return *available_kernels().back();
+}
+
+const FlockKernels* find_kernels(const std::string& name)
+{
+	std::vector<const FlockKernels*> kernels = available_kernels();
+	for (unsigned int i = 0; i < kernels.size(); i ++) {
+		if (name == kernels[i]->name) {
+			return kernels[i];
+		}
+	}
+	return nullptr;
+}
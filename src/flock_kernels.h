@@ -0,0 +1,86 @@
+#ifndef FLOCK_KERNELS_H
+#define FLOCK_KERNELS_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "flock_storage.h"
+#include "obstacle.h"
+#include "spatial_grid.h"
+
+// Vectorized versions of the neighbor loops of the flock rules. The kernels work
+// on flat float arrays so that SSE and AVX2 builds can test 4 or 8 neighbors
+// with a single instruction, using distance-squared comparisons and masked
+// accumulation. A kernel set is chosen at runtime depending on the CPU.
+
+// Sums accumulated by the cohesion, separation and alignment rules.
+struct FlockSums {
+	glm::vec3 avg_position = glm::vec3(0.0f, 0.0f, 0.0f);
+	glm::vec3 displacement = glm::vec3(0.0f, 0.0f, 0.0f);
+	glm::vec3 orientation = glm::vec3(0.0f, 0.0f, 0.0f);
+	float count = 0.0f;
+};
+
+// Copy of the flock's positions and velocities as separate float arrays. When a
+// spatial grid is used, Boids are stored in the grid's slot order so that every
+// bucket is a contiguous range.
+class NeighborArrays {
+public:
+	// Method that refreshes the arrays from the flock, in the order of the given
+	// grid (which must have been rebuilt over this flock), or in index order.
+	void gather(const FlockStorage& flock, const SpatialGrid* grid);
+
+	unsigned int size() const { return index.size(); }
+
+	std::vector<float> x, y, z;
+	std::vector<float> vx, vy, vz;
+	std::vector<unsigned int> index;
+};
+
+// Copy of the obstacles' centers and radii as separate float arrays.
+class ObstacleArrays {
+public:
+	// Method that appends the obstacles added since the last call. Obstacles
+	// never move.
+	void sync(ObstacleView obstacles);
+
+	// Method that removes obstacle i by moving the last obstacle into its
+	// place, as done to the obstacle array it copies.
+	void remove(unsigned int i);
+
+	unsigned int size() const { return x.size(); }
+
+	std::vector<float> x, y, z;
+	std::vector<float> radius;
+};
+
+// Kernel that accumulates the flock rules of the Boid `self` at `center` over
+// the neighbors stored in [begin, end).
+typedef void (*FlockKernel)(const NeighborArrays& neighbors, unsigned int begin, unsigned int end,
+                            const glm::vec3& center, unsigned int self, FlockSums& sums);
+
+// Kernel that returns the sum of the obstacle avoidance displacements at
+// `center` (before scaling) over the obstacles stored in [begin, end).
+typedef glm::vec3 (*ObstacleKernel)(const ObstacleArrays& obstacles, unsigned int begin, unsigned int end,
+                                    const glm::vec3& center);
+
+struct FlockKernels {
+	const char* name;
+	FlockKernel flock;
+	ObstacleKernel obstacles;
+};
+
+// Portable kernels, available everywhere.
+const FlockKernels& scalar_kernels();
+
+// Kernel sets supported by this build and CPU, fastest last.
+std::vector<const FlockKernels*> available_kernels();
+
+// Fastest kernel set supported by this CPU.
+const FlockKernels& best_kernels();
+
+// Kernel set with the given name ("scalar", "sse" or "avx2") if supported, or
+// nullptr otherwise.
+const FlockKernels* find_kernels(const std::string& name);
+
+#endif
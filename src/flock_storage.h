@@ -0,0 +1,64 @@
+#ifndef FLOCK_STORAGE_H
+#define FLOCK_STORAGE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+// Structure-of-arrays storage for the state of every Boid in the flock.
+// Boid i is made of the i-th element of each array. Neighbor loops only read
+// `position` and `velocity`, which are kept in their own contiguous arrays so
+// that scanning the flock does not pull orientation data into cache.
+//
+// `position` and `orientation` are also everything needed to draw a Boid: the
+// renderer instances one shared mesh with them.
+class FlockStorage {
+public:
+	unsigned int size() const {
+		return position.size();
+	}
+
+	void reserve(unsigned int count) {
+		position.reserve(count);
+		velocity.reserve(count);
+		orientation.reserve(count);
+	}
+
+	// Method that appends a Boid with the given state and returns its index.
+	unsigned int add(const glm::vec3& center, const glm::vec3& boid_velocity, const glm::quat& boid_orientation) {
+		position.push_back(center);
+		velocity.push_back(boid_velocity);
+		orientation.push_back(boid_orientation);
+		return position.size() - 1;
+	}
+
+	// Method that removes Boid i in O(1) by moving the last Boid into its place.
+	void remove(unsigned int i) {
+		position[i] = position.back();
+		velocity[i] = velocity.back();
+		orientation[i] = orientation.back();
+		position.pop_back();
+		velocity.pop_back();
+		orientation.pop_back();
+	}
+
+	// Speed limit shared by every Boid in the flock.
+	float velocity_limit = 0.6f;
+
+	// Hot data: read for every neighbor by the flock rules.
+	std::vector<glm::vec3> position;
+	std::vector<glm::vec3> velocity;
+
+	// Orientation: rotation from the Boid's model space (see Boid::mesh) to
+	// the world. Only read and written by the Boid itself.
+	std::vector<glm::quat> orientation;
+};
+
+// Everything needed to draw one Boid, laid out as the per-instance vertex
+// attributes of the renderer: position (3 floats) and orientation (x, y, z, w).
+struct BoidInstance {
+	glm::vec3 position;
+	glm::quat orientation;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "frame_histogram.h"
+#include <iomanip>
+#include <string>
+
+void FrameHistogram::add(double seconds)
+{
+	int bucket = (int) (seconds * 1000.0);
+	counts[bucket < kBuckets ? bucket : kBuckets] ++;
+	frames ++;
+	total_seconds += seconds;
+	if (seconds > longest_seconds) {
+		longest_seconds = seconds;
+	}
+}
+
+void FrameHistogram::reset()
+{
+	*this = FrameHistogram();
+}
+
+int FrameHistogram::percentile(double fraction) const
+{
+	unsigned long long seen = 0;
+	for (int bucket = 0; bucket <= kBuckets; bucket ++) {
+		seen += counts[bucket];
+		if (seen >= fraction * frames) {
+			return bucket + 1;
+		}
+	}
+	return kBuckets + 1;
+}
+
+void FrameHistogram::report(std::ostream& out) const
+{
+	if (frames == 0) {
+		out << "No frames recorded\n";
+		return;
+	}
+
+	out << frames << " frames, mean " << std::fixed << std::setprecision(2)
+	    << 1000.0 * total_seconds / frames << " ms, max " << 1000.0 * longest_seconds << " ms, "
+	    << "p50 < " << percentile(0.5) << " ms, p90 < " << percentile(0.9) << " ms, "
+	    << "p99 < " << percentile(0.99) << " ms\n";
+
+	unsigned long long largest = 0;
+	for (int bucket = 0; bucket <= kBuckets; bucket ++) {
+		if (counts[bucket] > largest) {
+			largest = counts[bucket];
+		}
+	}
+
+	for (int bucket = 0; bucket <= kBuckets; bucket ++) {
+		if (counts[bucket] == 0) {
+			continue;
+		}
+		if (bucket < kBuckets) {
+			out << std::setw(3) << bucket << "-" << std::setw(3) << bucket + 1 << " ms ";
+		} else {
+			out << std::setw(3) << kBuckets << "+    ms ";
+		}
+		int width = (int) (50 * counts[bucket] / largest);
+		out << std::setw(8) << counts[bucket] << " " << std::string(width > 0 ? width : 1, '#') << "\n";
+	}
+	out << std::defaultfloat;
+}
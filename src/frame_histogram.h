@@ -0,0 +1,34 @@
+#ifndef FRAME_HISTOGRAM_H
+#define FRAME_HISTOGRAM_H
+
+#include <ostream>
+
+// Histogram of frame times in 1 ms buckets. An average frame time hides the
+// occasional long frame caused by a driver stall; the histogram and its
+// percentiles show how often they happen. Frames of kBuckets ms or longer
+// share the last bucket.
+class FrameHistogram {
+public:
+	// Method that records a frame that took the given time.
+	void add(double seconds);
+
+	void reset();
+
+	// Method that prints the number of frames, the mean, 50th, 90th and 99th
+	// percentiles and maximum frame time, and a bar per non-empty bucket.
+	void report(std::ostream& out) const;
+
+private:
+	static const int kBuckets = 50;
+
+	// Method that returns the upper bound, in ms, of the bucket containing the
+	// given fraction of the frames.
+	int percentile(double fraction) const;
+
+	unsigned long long counts[kBuckets + 1] = {};
+	unsigned long long frames = 0;
+	double total_seconds = 0.0;
+	double longest_seconds = 0.0;
+};
+
+#endif
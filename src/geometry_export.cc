@@ -0,0 +1,330 @@
+#include "geometry_export.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	// Output file with a large buffer of its own. Numbers are formatted by
+	// hand into the buffer, which is written out in large blocks, so no
+	// stream or printf call is made per value.
+	class BufferedFile {
+	public:
+		BufferedFile(FILE* file, std::vector<char>& buffer) : file(file), buffer(buffer) {
+			buffer.resize(kSize);
+		}
+
+		~BufferedFile() {
+			flush();
+		}
+
+		bool ok() const { return !failed; }
+
+		void put(char c) {
+			reserve(1);
+			buffer[used ++] = c;
+		}
+
+		void put(const char* text) {
+			size_t length = std::strlen(text);
+			reserve(length);
+			std::memcpy(&buffer[used], text, length);
+			used += length;
+		}
+
+		template <typename T>
+		void put_binary(const T& value) {
+			reserve(sizeof(T));
+			std::memcpy(&buffer[used], &value, sizeof(T));
+			used += sizeof(T);
+		}
+
+		void put_uint(uint64_t value) {
+			char digits[20];
+			int count = 0;
+			do {
+				digits[count ++] = '0' + value % 10;
+				value /= 10;
+			} while (value > 0);
+			reserve(count);
+			while (count > 0) {
+				buffer[used ++] = digits[-- count];
+			}
+		}
+
+		// Method that writes the value with up to 6 decimals, without
+		// trailing zeros.
+		void put_float(float value) {
+			if (!std::isfinite(value) || std::fabs(value) >= 1e9f) {
+				char text[32];
+				std::snprintf(text, sizeof(text), "%g", value);
+				put(text);
+				return;
+			}
+			double x = value;
+			if (x < 0.0) {
+				put('-');
+				x = -x;
+			}
+			uint64_t scaled = (uint64_t) (x * 1e6 + 0.5);
+			put_uint(scaled / 1000000);
+			uint32_t fraction = scaled % 1000000;
+			if (fraction == 0) {
+				return;
+			}
+			char digits[7] = { '.' };
+			int count = 6;
+			for (int i = 6; i >= 1; i --) {
+				digits[i] = '0' + fraction % 10;
+				fraction /= 10;
+			}
+			while (digits[count] == '0') {
+				count --;
+			}
+			reserve(count + 1);
+			std::memcpy(&buffer[used], digits, count + 1);
+			used += count + 1;
+		}
+
+		void flush() {
+			if (used > 0 && std::fwrite(buffer.data(), 1, used, file) != used) {
+				failed = true;
+			}
+			used = 0;
+		}
+
+	private:
+		static const size_t kSize = 1 << 20;
+
+		void reserve(size_t bytes) {
+			if (used + bytes > kSize) {
+				flush();
+			}
+		}
+
+		FILE* file;
+		std::vector<char>& buffer;
+		size_t used = 0;
+		bool failed = false;
+	};
+
+	// Method that calls `vertex(v)` with every vertex of the snapshot in world
+	// space, Boids first.
+	template <typename Visitor>
+	void for_each_vertex(const GeometrySnapshot& snapshot, Visitor vertex) {
+		for (unsigned int b = 0; b < snapshot.boids.size(); b ++) {
+			const BoidInstance& boid = snapshot.boids[b];
+			for (unsigned int v = 0; v < snapshot.boid_vertices.size(); v ++) {
+				vertex(boid.position + boid.orientation * glm::vec3(snapshot.boid_vertices[v]));
+			}
+		}
+		for (unsigned int v = 0; v < snapshot.obstacle_vertices.size(); v ++) {
+			vertex(glm::vec3(snapshot.obstacle_vertices[v]));
+		}
+	}
+
+	// Method that calls `face(f)` with every face of the snapshot, indexing
+	// the vertices in the order of for_each_vertex().
+	template <typename Visitor>
+	void for_each_face(const GeometrySnapshot& snapshot, Visitor face) {
+		unsigned int boid_vertex_count = snapshot.boid_vertices.size();
+		for (unsigned int b = 0; b < snapshot.boids.size(); b ++) {
+			glm::uvec3 base = glm::uvec3(b * boid_vertex_count);
+			for (unsigned int f = 0; f < snapshot.boid_faces.size(); f ++) {
+				face(snapshot.boid_faces[f] + base);
+			}
+		}
+		glm::uvec3 base = glm::uvec3(snapshot.boids.size() * boid_vertex_count);
+		for (unsigned int f = 0; f < snapshot.obstacle_faces.size(); f ++) {
+			face(snapshot.obstacle_faces[f] + base);
+		}
+	}
+
+	void write_obj(const GeometrySnapshot& snapshot, BufferedFile& out) {
+		out.put("# ");
+		out.put_uint(snapshot.boids.size());
+		out.put(" boids, ");
+		out.put_uint(snapshot.obstacle_count);
+		out.put(" obstacles\n");
+		for_each_vertex(snapshot, [&](const glm::vec3& v) {
+			out.put("v ");
+			out.put_float(v.x);
+			out.put(' ');
+			out.put_float(v.y);
+			out.put(' ');
+			out.put_float(v.z);
+			out.put('\n');
+		});
+		// OBJ indices start at 1.
+		for_each_face(snapshot, [&](const glm::uvec3& f) {
+			out.put("f ");
+			out.put_uint(f.x + 1);
+			out.put(' ');
+			out.put_uint(f.y + 1);
+			out.put(' ');
+			out.put_uint(f.z + 1);
+			out.put('\n');
+		});
+	}
+
+	// The values are written in the byte order of the machine, which the
+	// header declares as little-endian.
+	void write_ply(const GeometrySnapshot& snapshot, BufferedFile& out) {
+		uint64_t vertex_count = (uint64_t) snapshot.boids.size() * snapshot.boid_vertices.size() +
+		                        snapshot.obstacle_vertices.size();
+		uint64_t face_count = (uint64_t) snapshot.boids.size() * snapshot.boid_faces.size() +
+		                      snapshot.obstacle_faces.size();
+		out.put("ply\nformat binary_little_endian 1.0\nelement vertex ");
+		out.put_uint(vertex_count);
+		out.put("\nproperty float x\nproperty float y\nproperty float z\nelement face ");
+		out.put_uint(face_count);
+		out.put("\nproperty list uchar int vertex_indices\nend_header\n");
+		for_each_vertex(snapshot, [&](const glm::vec3& v) {
+			out.put_binary(v.x);
+			out.put_binary(v.y);
+			out.put_binary(v.z);
+		});
+		for_each_face(snapshot, [&](const glm::uvec3& f) {
+			out.put_binary((uint8_t) 3);
+			out.put_binary((int32_t) f.x);
+			out.put_binary((int32_t) f.y);
+			out.put_binary((int32_t) f.z);
+		});
+	}
+
+	// Method that writes the snapshot through the given buffer.
+	bool write_file(const GeometrySnapshot& snapshot, const std::string& path, GeometryFormat format,
+	                std::vector<char>& buffer, std::string& error) {
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr) {
+			error = "cannot create " + path;
+			return false;
+		}
+		bool written;
+		{
+			BufferedFile out(file, buffer);
+			if (format == kPlyFormat) {
+				write_ply(snapshot, out);
+			} else {
+				write_obj(snapshot, out);
+			}
+			out.flush();
+			written = out.ok();
+		}
+		written = std::fclose(file) == 0 && written;
+		if (!written) {
+			error = "cannot write " + path;
+		}
+		return written;
+	}
+}
+
+void GeometrySnapshot::capture(const Scene& scene)
+{
+	const FlockStorage& flock = scene.simulation.flock();
+	boids.resize(flock.size());
+	for (unsigned int i = 0; i < flock.size(); i ++) {
+		boids[i].position = flock.position[i];
+		boids[i].orientation = flock.orientation[i];
+	}
+	obstacle_count = scene.obstacles.size();
+	boid_vertices = scene.boids_vertices;
+	boid_faces = scene.boids_faces;
+	obstacle_vertices = scene.obstacles_vertices;
+	obstacle_faces = scene.obstacles_faces;
+}
+
+std::string geometry_path(const std::string& prefix, uint64_t frame, GeometryFormat format)
+{
+	char number[32];
+	std::snprintf(number, sizeof(number), "_%06llu", (unsigned long long) frame);
+	return prefix + number + (format == kPlyFormat ? ".ply" : ".obj");
+}
+
+bool write_geometry(const GeometrySnapshot& snapshot, const std::string& path, GeometryFormat format,
+                    std::string& error)
+{
+	std::vector<char> buffer;
+	return write_file(snapshot, path, format, buffer, error);
+}
+
+GeometryExporter::~GeometryExporter()
+{
+	finish();
+}
+
+void GeometryExporter::submit(const Scene& scene, const std::string& path, GeometryFormat format)
+{
+	// Take a spare job, waiting if the disk is too far behind.
+	Job job;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (!thread.joinable()) {
+			closing = false;
+			thread = std::thread(&GeometryExporter::run, this);
+		}
+		changed.wait(lock, [&]() { return queued.size() < kMaxQueued; });
+		if (!free_jobs.empty()) {
+			job = std::move(free_jobs.back());
+			free_jobs.pop_back();
+		}
+	}
+
+	job.snapshot.capture(scene);
+	job.path = path;
+	job.format = format;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	queued.push_back(std::move(job));
+	changed.notify_all();
+}
+
+bool GeometryExporter::finish()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+		changed.notify_all();
+	}
+	if (thread.joinable()) {
+		thread.join();
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	return !failed;
+}
+
+unsigned int GeometryExporter::exported() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return exported_count;
+}
+
+void GeometryExporter::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		changed.wait(lock, [&]() { return closing || !queued.empty(); });
+		if (queued.empty()) {
+			return;
+		}
+		Job job = std::move(queued.front());
+		queued.pop_front();
+		lock.unlock();
+
+		std::string error;
+		bool written = write_file(job.snapshot, job.path, job.format, write_buffer, error);
+		if (!written) {
+			std::cerr << "Cannot export the geometry: " << error << "\n";
+		}
+
+		lock.lock();
+		if (written) {
+			exported_count ++;
+		} else {
+			failed = true;
+		}
+		free_jobs.push_back(std::move(job));
+		changed.notify_all();
+	}
+}
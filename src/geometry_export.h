@@ -0,0 +1,93 @@
+#ifndef GEOMETRY_EXPORT_H
+#define GEOMETRY_EXPORT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "flock_storage.h"
+#include "scene.h"
+
+// File formats the geometry of a frame can be exported to: Wavefront OBJ
+// (text), or binary little-endian PLY, which is smaller and much faster to
+// write and load.
+enum GeometryFormat {
+	kObjFormat,
+	kPlyFormat,
+};
+
+// Everything needed to export the geometry of one frame of a scene: the Boid
+// mesh with the position and orientation of every Boid, and the obstacles.
+struct GeometrySnapshot {
+	// Method that copies the current frame of the scene.
+	void capture(const Scene& scene);
+
+	std::vector<BoidInstance> boids;
+	unsigned int obstacle_count = 0;
+	std::vector<glm::vec4> boid_vertices;
+	std::vector<glm::uvec3> boid_faces;
+	std::vector<glm::vec4> obstacle_vertices;
+	std::vector<glm::uvec3> obstacle_faces;
+};
+
+// Method that returns the file the given frame is exported to:
+// `prefix`_NNNNNN.obj or .ply.
+std::string geometry_path(const std::string& prefix, uint64_t frame, GeometryFormat format);
+
+// Method that writes the snapshot to the given file as one mesh in world
+// space: the Boid mesh once per Boid, then the obstacles. Returns false, with
+// the reason in `error`, if the file could not be written.
+bool write_geometry(const GeometrySnapshot& snapshot, const std::string& path, GeometryFormat format,
+                    std::string& error);
+
+// Exports frames on a background thread. The caller only copies the scene;
+// formatting and writing happen on the exporter's thread, which is started by
+// the first export. Snapshots are reused, so exporting the same scene again
+// does not allocate.
+class GeometryExporter {
+public:
+	GeometryExporter() {}
+	~GeometryExporter();
+
+	// Method that captures the current frame of the scene and queues it to be
+	// written to the given file. It only waits if several exports are still
+	// pending. Failures are reported to std::cerr.
+	void submit(const Scene& scene, const std::string& path, GeometryFormat format);
+
+	// Method that waits for every queued export. Returns whether all the
+	// exports so far succeeded.
+	bool finish();
+
+	// Number of files written successfully.
+	unsigned int exported() const;
+
+private:
+	struct Job {
+		GeometrySnapshot snapshot;
+		std::string path;
+		GeometryFormat format;
+	};
+
+	// Method run by the background thread.
+	void run();
+
+	static const size_t kMaxQueued = 2;
+
+	std::thread thread;
+	mutable std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<Job> queued;
+	std::vector<Job> free_jobs;
+	bool closing = false;
+	bool failed = false;
+	unsigned int exported_count = 0;
+
+	// Only touched by the background thread.
+	std::vector<char> write_buffer;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "gpu_timer.h"
+
+GpuTimer::GpuTimer()
+{
+	supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+}
+
+GpuTimer::~GpuTimer()
+{
+	for (const Query& query : pending) {
+		glDeleteQueries(1, &query.id);
+	}
+	if (!free_queries.empty()) {
+		glDeleteQueries(free_queries.size(), free_queries.data());
+	}
+}
+
+void GpuTimer::begin(const char* name)
+{
+	if (!supported || !g_profiler.enabled()) {
+		return;
+	}
+	Query query;
+	if (free_queries.empty()) {
+		glGenQueries(1, &query.id);
+	} else {
+		query.id = free_queries.back();
+		free_queries.pop_back();
+	}
+	query.name = name;
+	query.issued = Profiler::Clock::now();
+	glBeginQuery(GL_TIME_ELAPSED, query.id);
+	pending.push_back(query);
+	active = true;
+}
+
+void GpuTimer::end()
+{
+	if (active) {
+		glEndQuery(GL_TIME_ELAPSED);
+		active = false;
+	}
+}
+
+void GpuTimer::collect(Profiler& profiler)
+{
+	// Queries complete in the order they were issued, so stop at the first
+	// one that is not ready.
+	unsigned int ready = 0;
+	for (; ready < pending.size(); ready ++) {
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(pending[ready].id, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == GL_FALSE) {
+			break;
+		}
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(pending[ready].id, GL_QUERY_RESULT, &nanoseconds);
+		if (profiler.enabled()) {
+			profiler.record_gpu(pending[ready].name, pending[ready].issued, nanoseconds * 1e-9);
+		}
+		free_queries.push_back(pending[ready].id);
+	}
+	pending.erase(pending.begin(), pending.begin() + ready);
+}
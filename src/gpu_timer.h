@@ -0,0 +1,44 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <GL/glew.h>
+#include <vector>
+#include "profiler.h"
+
+// GPU side of the frame profiler. The commands issued between begin() and
+// end() are timed with a GL_TIME_ELAPSED query. Results are read a few frames
+// later, once the GPU has finished them, so collecting them never stalls the
+// pipeline. Phases may not nest, since only one elapsed-time query can be
+// active at a time.
+//
+// Timer queries are core in OpenGL 3.3; on a context without them the timer
+// does nothing.
+class GpuTimer {
+public:
+	GpuTimer();
+	~GpuTimer();
+
+	bool available() const { return supported; }
+
+	// Methods that delimit the GPU phase `name` (a string literal). They do
+	// nothing while the profiler is disabled.
+	void begin(const char* name);
+	void end();
+
+	// Method that hands the results that are ready to the profiler.
+	void collect(Profiler& profiler);
+
+private:
+	struct Query {
+		GLuint id;
+		const char* name;
+		Profiler::Clock::time_point issued;
+	};
+
+	bool supported;
+	bool active = false;
+	std::vector<Query> pending;  // In the order they were issued.
+	std::vector<GLuint> free_queries;
+};
+
+#endif
@@ -0,0 +1,161 @@
+#include "headless.h"
+#include "alloc_counter.h"
+#include "checkpoint.h"
+#include "profiler.h"
+#include "trajectory.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+namespace {
+	// Largest distance between the positions of the same Boid in two flocks,
+	// or infinity if they do not have the same Boids.
+	float max_deviation(const FlockStorage& a, const FlockStorage& b) {
+		if (a.size() != b.size()) {
+			return std::numeric_limits<float>::infinity();
+		}
+		float deviation = 0.0f;
+		for (unsigned int i = 0; i < a.size(); i ++) {
+			float d = glm::length(a.position[i] - b.position[i]);
+			if (!(d <= deviation)) {
+				deviation = d;
+			}
+		}
+		return deviation;
+	}
+}
+
+int run_headless(Scene& scene, const HeadlessOptions& options)
+{
+	std::cout << "Headless run: " << options.steps << " steps, "
+	          << scene.simulation.flock().size() << " boids, "
+	          << scene.obstacles.size() << " obstacles\n";
+
+	TrajectoryWriter recorder;
+	if (!options.record.empty()) {
+		size_t frames = 1 + (options.steps > 0 ? options.steps / options.record_every : 0);
+		if (!recorder.open(options.record, options.quantize, scene.obstacles_vertices, scene.obstacles_faces, frames,
+		                   scene.simulation.flock().size())) {
+			std::cerr << "Cannot record the run: " << recorder.error() << "\n";
+			return EXIT_FAILURE;
+		}
+		recorder.write_frame(0, scene.simulation.flock());
+	}
+
+	GeometryExporter exporter;
+	if (!options.export_prefix.empty()) {
+		exporter.submit(scene, geometry_path(options.export_prefix, 0, options.export_format), options.export_format);
+	}
+
+	TrajectoryReader reference;
+	FlockStorage reference_flock;
+	size_t reference_frame = 0;
+	size_t compared_frames = 0;
+	float deviation = 0.0f;
+	long long first_divergent_step = -1;
+	if (!options.compare.empty() && !reference.open(options.compare)) {
+		std::cerr << "Cannot compare the run: " << reference.error() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	// Method that compares the flock after the given step with the frame of
+	// the reference trajectory recorded after the same step, if there is one.
+	auto compare = [&](uint64_t step) {
+		while (reference_frame < reference.frame_count() && reference.step(reference_frame) < step) {
+			reference_frame ++;
+		}
+		if (reference_frame == reference.frame_count() || reference.step(reference_frame) != step) {
+			return;
+		}
+		reference.read_frame(reference_frame, reference_flock);
+		float d = max_deviation(scene.simulation.flock(), reference_flock);
+		if (d > reference.position_error() && first_divergent_step < 0) {
+			first_divergent_step = step;
+		}
+		deviation = d > deviation ? d : deviation;
+		compared_frames ++;
+	};
+	compare(0);
+
+	// The first step allocates the buffers of the simulation; leave it out of
+	// the allocation count. Everything else done per step is counted, except
+	// the geometry export, which names and queues a new file every time. The
+	// profiler, when enabled, also allocates to store what it records. Only
+	// the steps are timed, not the recording.
+	size_t allocations = 0;
+	double seconds = 0.0;
+	for (int i = 0; i < options.steps; i ++) {
+		size_t allocations_before_step = alloc_counter::allocations();
+		auto start = std::chrono::steady_clock::now();
+		scene.step();
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		g_profiler.end_frame();
+
+		uint64_t step = i + 1;
+		if (!options.record.empty() && step % options.record_every == 0) {
+			recorder.write_frame(step, scene.simulation.flock());
+		}
+		if (!options.compare.empty()) {
+			compare(step);
+		}
+		if (i > 0) {
+			allocations += alloc_counter::allocations() - allocations_before_step;
+		}
+
+		if (!options.export_prefix.empty() && step % options.export_every == 0) {
+			exporter.submit(scene, geometry_path(options.export_prefix, step, options.export_format),
+			                options.export_format);
+		}
+	}
+
+	// Sum of all positions, to compare the outcome of different runs.
+	const FlockStorage& flock = scene.simulation.flock();
+	double checksum = 0.0;
+	for (unsigned int i = 0; i < flock.size(); i ++) {
+		checksum += flock.position[i].x + flock.position[i].y + flock.position[i].z;
+	}
+
+	std::cout << "Total time: " << seconds << " s\n";
+	std::cout << "Time per step: " << 1000.0 * seconds / (options.steps > 0 ? options.steps : 1) << " ms\n";
+	std::cout << "Heap allocations after the first step: " << allocations << "\n";
+	std::cout.precision(17);
+	std::cout << "Position checksum: " << checksum << "\n";
+	std::cout.precision(6);
+
+	int status = EXIT_SUCCESS;
+	if (!options.record.empty()) {
+		if (recorder.close()) {
+			std::cout << "Recorded to " << options.record << "\n";
+		} else {
+			std::cerr << "Cannot record the run: " << recorder.error() << "\n";
+			status = EXIT_FAILURE;
+		}
+	}
+	if (!options.compare.empty()) {
+		std::cout << "Compared " << compared_frames << " frames with " << options.compare
+		          << ": largest position deviation " << deviation << "\n";
+		if (first_divergent_step >= 0) {
+			std::cout << "Runs diverge after step " << first_divergent_step << "\n";
+			status = EXIT_FAILURE;
+		}
+	}
+	if (!options.export_prefix.empty()) {
+		bool exported = exporter.finish();
+		std::cout << "Exported " << exporter.exported() << " frames to " << options.export_prefix << "_*"
+		          << (options.export_format == kPlyFormat ? ".ply" : ".obj") << "\n";
+		if (!exported) {
+			status = EXIT_FAILURE;
+		}
+	}
+	if (!options.checkpoint.empty()) {
+		std::string error;
+		if (save_checkpoint(scene, options.checkpoint, error)) {
+			std::cout << "Saved checkpoint to " << options.checkpoint << "\n";
+		} else {
+			std::cerr << "Cannot save the checkpoint: " << error << "\n";
+			status = EXIT_FAILURE;
+		}
+	}
+	return status;
+}
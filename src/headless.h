@@ -0,0 +1,38 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <string>
+#include "geometry_export.h"
+#include "scene.h"
+
+// Parameters of a simulation run without a window.
+struct HeadlessOptions {
+	int steps = 1000;
+
+	// Trajectory file the flock is recorded to every `record_every` steps,
+	// if not empty, with quantized values if `quantize` is set.
+	std::string record;
+	int record_every = 1;
+	bool quantize = false;
+
+	// Trajectory file the run is compared with, if not empty. Every frame it
+	// holds is compared with the flock after the same step.
+	std::string compare;
+
+	// Prefix of the files the geometry of the scene is exported to every
+	// `export_every` steps, if not empty. Files are written in the background.
+	std::string export_prefix;
+	int export_every = 1;
+	GeometryFormat export_format = kObjFormat;
+
+	// Checkpoint file the final state of the scene is saved to, if not empty.
+	std::string checkpoint;
+};
+
+// Method that runs the simulation of the given scene for the requested number
+// of steps without making any OpenGL or GLFW call, then prints a summary.
+// Returns the process exit status, which is a failure if the run could not be
+// recorded, exported or saved, or deviates from the one it is compared with.
+int run_headless(Scene& scene, const HeadlessOptions& options);
+
+#endif
@@ -0,0 +1,177 @@
+#include "job_system.h"
+#include <chrono>
+#include <iomanip>
+
+namespace {
+	double seconds_since(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+JobSystem::JobSystem(int worker_count)
+{
+	count = worker_count > 0 ? worker_count : 1;
+	workers.reset(new Worker[count]);
+	for (int id = 1; id < count; id ++) {
+		threads.push_back(std::thread(&JobSystem::thread_main, this, id));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	start.notify_all();
+	for (unsigned int i = 0; i < threads.size(); i ++) {
+		threads[i].join();
+	}
+}
+
+void JobSystem::run(unsigned int size, unsigned int chunk, Invoker invoker, void* body)
+{
+	if (size == 0) {
+		return;
+	}
+	auto begin = std::chrono::steady_clock::now();
+
+	// Give every worker a contiguous block of chunks.
+	unsigned int chunks = (size + chunk - 1) / chunk;
+	for (int id = 0; id < count; id ++) {
+		std::lock_guard<std::mutex> lock(workers[id].mutex);
+		workers[id].head = (unsigned long long) chunks * id / count;
+		workers[id].tail = (unsigned long long) chunks * (id + 1) / count;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->invoker = invoker;
+		this->body = body;
+		this->size = size;
+		this->chunk = chunk;
+		running = count - 1;
+		generation ++;
+	}
+	start.notify_all();
+
+	// The calling thread works as well, then waits for the others.
+	work(0);
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		finish.wait(lock, [this] { return running == 0; });
+	}
+
+	wall_seconds += seconds_since(begin);
+}
+
+void JobSystem::work(int id)
+{
+	WorkerStats& stats = workers[id].stats;
+	unsigned int chunk_index;
+
+	// No chunk creates new work, so once a worker finds nothing to run or steal,
+	// every remaining chunk is already being run by another worker.
+	while (true) {
+		if (!pop(id, chunk_index)) {
+			if (steal(id)) {
+				continue;
+			}
+			break;
+		}
+
+		auto begin = std::chrono::steady_clock::now();
+		unsigned int first = chunk_index * chunk;
+		unsigned int last = first + chunk < size ? first + chunk : size;
+		invoker(body, first, last);
+		stats.busy_seconds += seconds_since(begin);
+		stats.chunks ++;
+	}
+}
+
+bool JobSystem::pop(int id, unsigned int& chunk_index)
+{
+	Worker& worker = workers[id];
+	std::lock_guard<std::mutex> lock(worker.mutex);
+	if (worker.head == worker.tail) {
+		return false;
+	}
+	chunk_index = worker.head ++;
+	return true;
+}
+
+bool JobSystem::steal(int id)
+{
+	// Visit the other workers in order, starting with the next one, and take the
+	// back half of the first non-empty block found.
+	for (int offset = 1; offset < count; offset ++) {
+		Worker& victim = workers[(id + offset) % count];
+		unsigned int head, tail;
+		{
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			unsigned int remaining = victim.tail - victim.head;
+			if (remaining == 0) {
+				continue;
+			}
+			tail = victim.tail;
+			head = tail - (remaining + 1) / 2;
+			victim.tail = head;
+		}
+
+		Worker& self = workers[id];
+		std::lock_guard<std::mutex> lock(self.mutex);
+		self.head = head;
+		self.tail = tail;
+		self.stats.steals ++;
+		self.stats.stolen += tail - head;
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::thread_main(int id)
+{
+	unsigned long long seen = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			start.wait(lock, [&] { return quit || generation != seen; });
+			if (quit) {
+				return;
+			}
+			seen = generation;
+		}
+
+		work(id);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running --;
+		}
+		finish.notify_one();
+	}
+}
+
+void JobSystem::reset_stats()
+{
+	for (int id = 0; id < count; id ++) {
+		workers[id].stats = WorkerStats();
+	}
+	wall_seconds = 0.0;
+}
+
+void JobSystem::report(std::ostream& out) const
+{
+	out << "worker\tbusy ms\tutil %\tchunks\tstolen\tsteals\n";
+	for (int id = 0; id < count; id ++) {
+		const WorkerStats& stats = workers[id].stats;
+		double utilization = wall_seconds > 0.0 ? 100.0 * stats.busy_seconds / wall_seconds : 0.0;
+		out << id << "\t"
+		    << std::fixed << std::setprecision(2) << 1000.0 * stats.busy_seconds << "\t"
+		    << std::setprecision(1) << utilization << "\t"
+		    << stats.chunks << "\t"
+		    << stats.stolen << "\t"
+		    << stats.steals << "\n";
+	}
+	out << std::defaultfloat;
+}
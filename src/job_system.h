@@ -0,0 +1,93 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// Small work-stealing job system. A parallel loop is split into chunks and every
+// worker starts with a contiguous block of them. Workers run their own chunks
+// front to back; a worker that runs out steals the back half of another worker's
+// remaining chunks. Uneven loops (e.g. Boids in dense clusters next to
+// stragglers) therefore keep every worker busy until the whole loop is done.
+//
+// The thread that calls parallel_for() takes part as worker 0, and the other
+// workers are persistent threads, so running a loop does not allocate.
+class JobSystem {
+public:
+	// Per-worker counters accumulated since the last reset_stats().
+	struct WorkerStats {
+		double busy_seconds = 0.0;  // Time spent running chunks.
+		unsigned long long chunks = 0;  // Chunks run by this worker.
+		unsigned long long stolen = 0;  // Chunks this worker took from others.
+		unsigned long long steals = 0;  // Successful steal operations.
+	};
+
+	explicit JobSystem(int worker_count);
+	~JobSystem();
+
+	int worker_count() const { return count; }
+
+	// Method that calls `body(begin, end)` for consecutive ranges of at most
+	// `chunk` indices covering [0, size), spread across the workers. Returns
+	// once every range has been processed.
+	template <typename Body>
+	void parallel_for(unsigned int size, unsigned int chunk, Body& body) {
+		run(size, chunk, &invoke<Body>, &body);
+	}
+
+	const WorkerStats& stats(int worker) const { return workers[worker].stats; }
+	void reset_stats();
+
+	// Method that prints per-worker utilization (busy time over the wall time
+	// spent inside parallel_for) since the last reset_stats().
+	void report(std::ostream& out) const;
+
+private:
+	typedef void (*Invoker)(void* body, unsigned int begin, unsigned int end);
+
+	template <typename Body>
+	static void invoke(void* body, unsigned int begin, unsigned int end) {
+		(*static_cast<Body*>(body))(begin, end);
+	}
+
+	// Chunks [head, tail) still waiting to run on a worker.
+	struct Worker {
+		std::mutex mutex;
+		unsigned int head = 0;
+		unsigned int tail = 0;
+		WorkerStats stats;
+	};
+
+	void run(unsigned int size, unsigned int chunk, Invoker invoker, void* body);
+	void work(int id);
+	bool pop(int id, unsigned int& chunk_index);
+	bool steal(int id);
+	void thread_main(int id);
+
+	int count;
+	std::unique_ptr<Worker[]> workers;
+	std::vector<std::thread> threads;
+
+	// Description of the loop being run.
+	Invoker invoker = nullptr;
+	void* body = nullptr;
+	unsigned int size = 0;
+	unsigned int chunk = 1;
+
+	// Wakes the threads up when a new loop starts and signals the caller when
+	// every thread is done with it.
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable finish;
+	unsigned long long generation = 0;
+	int running = 0;
+	bool quit = false;
+
+	double wall_seconds = 0.0;
+};
+
+#endif
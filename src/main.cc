@@ -1,3 +1,9 @@
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -15,11 +21,27 @@
 #include "camera.h"
 #include "boid.h"
 #include "obstacle.h"
+#include "flock_storage.h"
+#include "simulation.h"
+#include "scene.h"
+#include "trajectory.h"
+#include "checkpoint.h"
+#include "geometry_export.h"
+#include "headless.h"
+#include "profiler.h"
+#include "alloc_counter.h"
+#include "async_simulation.h"
+#include "stream_buffer.h"
+#include "fixed_timestep.h"
+#include "frame_histogram.h"
+#include "gpu_timer.h"
 
 int window_width = 800, window_height = 600;
 
-// VBO and VAO descriptors.
-enum { kVertexBuffer, kIndexBuffer, kNumVbos };
+// VBO and VAO descriptors. Meshes are drawn flat-shaded, with a copy of every
+// vertex per face carrying the face normal, so they need no index buffer. Boid
+// instances are streamed through a StreamBuffer.
+enum { kVertexBuffer, kNormalBuffer, kNumVbos };
 
 // These are our VAOs.
 enum { kBoidsVao, kObstaclesVao, kNumVaos };
@@ -32,43 +54,53 @@ GLuint g_buffer_objects[kNumVaos][kNumVbos];  // These will store VBO descriptor
 const char* vertex_shader =
 R"zzz(#version 330 core
 in vec4 vertex_position;
+in vec4 vertex_normal;
 uniform mat4 view;
+uniform mat4 projection;
 uniform vec4 light_position;
-out vec4 vs_light_direction;
-out vec3 vertex_world_position;
+flat out vec4 normal;
+flat out vec4 color_normal;
+out vec4 light_direction;
+out vec3 world_position;
 void main()
 {
-	gl_Position = view * vertex_position;
-	vs_light_direction = -gl_Position + view * light_position;
-	vertex_world_position = vec3(vertex_position.x, vertex_position.y, vertex_position.z);
+	vec4 view_position = view * vertex_position;
+	gl_Position = projection * view_position;
+	light_direction = -view_position + view * light_position;
+	color_normal = vertex_normal;
+	normal = view * vertex_normal;
+	world_position = vec3(vertex_position.x, vertex_position.y, vertex_position.z);
 }
 )zzz";
 
-const char* geometry_shader =
+// Boids are instances of one mesh: every vertex of the mesh, and its normal,
+// are rotated by the instance's orientation quaternion (stored as x, y, z, w)
+// and the vertex is moved to the instance's position.
+const char* boids_vertex_shader =
 R"zzz(#version 330 core
-layout (triangles) in;
-layout (triangle_strip, max_vertices = 3) out;
+in vec4 vertex_position;
+in vec4 vertex_normal;
+in vec3 instance_position;
+in vec4 instance_orientation;
 uniform mat4 view;
 uniform mat4 projection;
-in vec4 vs_light_direction[];
-in vec3 vertex_world_position[];
+uniform vec4 light_position;
 flat out vec4 normal;
 flat out vec4 color_normal;
 out vec4 light_direction;
 out vec3 world_position;
+vec3 rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
 void main()
 {
-	int n = 0;
-	vec3 co = normalize(cross(vertex_world_position[1] - vertex_world_position[0], vertex_world_position[2] - vertex_world_position[0]));
-	color_normal = vec4(co, 0.0);
+	world_position = instance_position + rotate(instance_orientation, vertex_position.xyz);
+	vec4 view_position = view * vec4(world_position, 1.0);
+	gl_Position = projection * view_position;
+	light_direction = -view_position + view * light_position;
+	color_normal = vec4(rotate(instance_orientation, vertex_normal.xyz), 0.0);
 	normal = view * color_normal;
-	for (n = 0; n < gl_in.length(); n++) {
-		light_direction = vs_light_direction[n];
-		gl_Position = projection * gl_in[n].gl_Position;
-		world_position = vertex_world_position[n];
-		EmitVertex();
-	}
-	EndPrimitive();
 }
 )zzz";
 
@@ -125,12 +157,66 @@ bool d_pressed = false;
 bool q_pressed = false;
 bool r_pressed = false;
 
+// Whether 'q' was pressed with shift, which adds a swarm of `swarm_size` boids
+// in a ball of radius `swarm_radius` instead of a single boid.
+bool q_swarm = false;
+int swarm_size = 1000;
+float swarm_radius = 5.0f;
+
 bool down_pressed = false;
 bool up_pressed = false;
 
 bool right_pressed = false;
 bool left_pressed = false;
 
+// Simulated scene. The neighbor and obstacle searches of its simulation are
+// toggled between their spatial indices and brute force with 'g' and 'o' to
+// compare both paths.
+Scene scene;
+Simulation& simulation = scene.simulation;
+
+// Frame times since the last report, printed with 'h' and on exit.
+FrameHistogram frame_histogram;
+
+// Clock that decides when the simulation ticks. Its tick counts are printed
+// with the frame times.
+FixedTimestep simulation_clock;
+
+// Thread that simulates the scene while the frames are drawn. Once it runs,
+// the scene is only changed through commands posted to it.
+AsyncSimulation simulation_thread(scene, simulation_clock);
+
+// How much the simulation overlapped with drawing, printed with 'h' and on exit.
+OverlapStats overlap_stats;
+
+// Trajectory shown instead of a simulation when replaying a recorded run, and
+// the step of it being shown, in ticks. The replay is paused with space, and
+// moved one second back or forward with '[' and ']'.
+TrajectoryReader replay;
+bool replaying = false;
+bool replay_paused = false;
+double replay_position = 0.0;
+
+// Files the profile is written to on exit, without extension. The profiler is
+// enabled with --profile or toggled with 'p'.
+std::string profile_prefix = "boids_profile";
+
+// Geometry of the current frame, exported with Ctrl+S to numbered files with
+// this prefix. The frame is copied on the simulation thread and written by
+// the exporter's thread.
+std::string export_prefix = "boids_frame";
+GeometryFormat export_format = kObjFormat;
+unsigned int export_count = 0;
+GeometryExporter geometry_exporter;
+
+// Stream picking the boids and obstacles removed with Delete and
+// Shift+Delete. Only used on the simulation thread.
+Random removal_random;
+
+// Checkpoint file the scene is saved to with F5 and restored from with F9.
+// Both run on the simulation thread, between two ticks.
+std::string checkpoint_path = "boids.checkpoint";
+
 // Method defined in Project 3 (Menger sponge) for tracking keyboard events.
 void
 KeyCallback(GLFWwindow* window,
@@ -145,7 +231,11 @@ KeyCallback(GLFWwindow* window,
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
 	else if (key == GLFW_KEY_S && mods == GLFW_MOD_CONTROL && action == GLFW_RELEASE) {
-		// FIXME: save geometry to OBJ
+		simulation_thread.post([](Scene& scene) {
+			std::string path = geometry_path(export_prefix, export_count ++, export_format);
+			std::cout << "Exporting geometry to " << path << "\n";
+			geometry_exporter.submit(scene, path, export_format);
+		});
 	} else if (key == GLFW_KEY_W && action != GLFW_RELEASE) {
 		w_pressed = true;
 	} else if (key == GLFW_KEY_S && action != GLFW_RELEASE) {
@@ -166,8 +256,78 @@ KeyCallback(GLFWwindow* window,
 		fpsMode = !fpsMode;
 	} else if (key == GLFW_KEY_Q && action != GLFW_RELEASE) {
 		q_pressed = true;
+		q_swarm = (mods & GLFW_MOD_SHIFT) != 0;
 	} else if (key == GLFW_KEY_R && action != GLFW_RELEASE) {
 		r_pressed = true;
+	} else if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+		simulation_thread.post([](Scene& scene) {
+			if (scene.simulation.jobs() != nullptr) {
+				scene.simulation.jobs()->report(std::cout);
+				scene.simulation.jobs()->reset_stats();
+			}
+		});
+	} else if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+		frame_histogram.report(std::cout);
+		frame_histogram.reset();
+		overlap_stats.report(std::cout);
+		overlap_stats.reset();
+		simulation_thread.post([](Scene&) {
+			simulation_clock.report(std::cout);
+			simulation_clock.reset_stats();
+		});
+	} else if (key == GLFW_KEY_SPACE && action == GLFW_PRESS && replaying) {
+		replay_paused = !replay_paused;
+	} else if (key == GLFW_KEY_LEFT_BRACKET && action != GLFW_RELEASE && replaying) {
+		replay_position = glm::max(0.0, replay_position - simulation_clock.tick_rate());
+	} else if (key == GLFW_KEY_RIGHT_BRACKET && action != GLFW_RELEASE && replaying) {
+		replay_position += simulation_clock.tick_rate();
+	} else if (key == GLFW_KEY_DELETE && action != GLFW_RELEASE && !replaying) {
+		bool obstacle = (mods & GLFW_MOD_SHIFT) != 0;
+		simulation_thread.post([obstacle](Scene& scene) {
+			HandleTable& handles = obstacle ? scene.obstacle_handles : scene.boid_handles;
+			if (handles.size() == 0) {
+				return;
+			}
+			EntityHandle handle = handles.handle(removal_random.below(handles.size()));
+			if (obstacle) {
+				scene.remove_obstacle(handle);
+			} else {
+				scene.remove_boid(handle);
+			}
+		});
+	} else if (key == GLFW_KEY_F5 && action == GLFW_PRESS && !replaying) {
+		simulation_thread.post([](Scene& scene) {
+			std::string error;
+			if (save_checkpoint(scene, checkpoint_path, error)) {
+				std::cout << "Saved checkpoint to " << checkpoint_path << "\n";
+			} else {
+				std::cerr << "Cannot save the checkpoint: " << error << "\n";
+			}
+		});
+	} else if (key == GLFW_KEY_F9 && action == GLFW_PRESS && !replaying) {
+		simulation_thread.post([](Scene& scene) {
+			std::string error;
+			if (load_checkpoint(scene, checkpoint_path, error)) {
+				std::cout << "Restored checkpoint from " << checkpoint_path << "\n";
+			} else {
+				std::cerr << "Cannot restore the checkpoint: " << error << "\n";
+			}
+		});
+	} else if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+		g_profiler.set_enabled(!g_profiler.enabled());
+		std::cout << "Profiler: " << (g_profiler.enabled() ? "on" : "off") << "\n";
+	} else if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+		simulation_thread.post([](Scene& scene) {
+			Simulation& simulation = scene.simulation;
+			simulation.use_obstacle_index = !simulation.use_obstacle_index;
+			std::cout << "Obstacle search: " << (simulation.use_obstacle_index ? "obstacle index" : "brute force") << "\n";
+		});
+	} else if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+		simulation_thread.post([](Scene& scene) {
+			Simulation& simulation = scene.simulation;
+			simulation.use_spatial_grid = !simulation.use_spatial_grid;
+			std::cout << "Neighbor search: " << (simulation.use_spatial_grid ? "spatial grid" : "brute force") << "\n";
+		});
 	}
 
 	if (key == GLFW_KEY_W && action == GLFW_RELEASE) {
@@ -337,13 +497,95 @@ checkInput() {
 	}
 }
 
+// Bytes of obstacle geometry sent to the GPU, printed on exit.
+size_t obstacle_upload_bytes = 0;
+
+// Method that sends the elements of `data` in the `dirty` range to the buffer
+// bound to `target`, whose allocated size in bytes is `capacity`. When the
+// array outgrows the buffer, the buffer is reallocated with twice the needed
+// size and the whole array is sent; otherwise only the dirty range is.
+template <typename T>
+void uploadDirtyRange(GLenum target, const std::vector<T>& data, DirtyRange dirty, size_t& capacity)
+{
+	if (!dirty.dirty()) {
+		return;
+	}
+
+	size_t size = sizeof(T) * data.size();
+	if (size > capacity) {
+		capacity = 2 * size;
+		CHECK_GL_ERROR(glBufferData(target, capacity, nullptr, GL_STATIC_DRAW));
+		dirty.mark(0, data.size());
+	}
+
+	size_t dirty_size = sizeof(T) * (dirty.end - dirty.begin);
+	CHECK_GL_ERROR(glBufferSubData(target, sizeof(T) * dirty.begin, dirty_size, &data[dirty.begin]));
+	obstacle_upload_bytes += dirty_size;
+}
+
+// Method that returns where to place an obstacle added along the ray from
+// `world_near_coordinate` to `world_far_coordinate`, drawing the distance from
+// `random`.
+glm::vec3
+obstaclePosition(glm::vec3 world_near_coordinate, glm::vec3 world_far_coordinate, Random& random) {
+	float r = random.uniform();
+	glm::vec3 position = world_near_coordinate + (world_far_coordinate - world_near_coordinate) * glm::max(r, 0.5f) * 0.2f;
+
+	// For the case of obstacles, we'll have to check whether the position we got
+	// is within the boundaries.
+	
+	// Attempt to locate the obstacle within the boundary.
+	int no_of_attempts = 0;
+	while (glm::length(position) > 50.0f && no_of_attempts < 20) {
+		r = random.uniform();
+		position = world_near_coordinate + (world_far_coordinate - world_near_coordinate) * glm::max(r, 0.5f) * 0.2f;
+		no_of_attempts ++;
+	}
+
+	// If this wasn't possible, we'll position the obstacle in the ray at a distance of 90 from the origin. 
+	if (no_of_attempts == 20) {
+		// We apply the quadratic formula to find the location over the ray
+		// that is at a distance of 90 from the origin.
+		float x, y, z;
+		float a, b, c;
+		glm::vec3 direction = glm::normalize(world_far_coordinate - world_near_coordinate);
+
+		a = world_near_coordinate.x;
+		b = world_near_coordinate.y;
+		c = world_near_coordinate.z;
+
+		x = direction.x;
+		y = direction.y;
+		z = direction.z;
+
+		float a_q, b_q, c_q;
+
+		a_q = x*x + y*y + z*z;
+		b_q = 2.0f * (a*x + b*y + c*z);
+		c_q = a*a + b*b + c*c - 80.0f*80.0f;
+
+		float k;
+
+		// Check if the equation has a solution.
+		// If no solution exists, we'll choose an aribitrary position for the obstacle
+		// (k = 200).
+		if (glm::sqrt(b_q*b_q - 4.0f*a_q*c_q) >= 0.0f) {
+			k = (-b_q + glm::sqrt(b_q*b_q - 4.0f*a_q*c_q)) / (2.0f * a_q);
+		} else {
+			k = 200.0f;
+		}
+		position = world_near_coordinate + direction * k;
+	}
+	return position;
+}
+
 // Method that checks the status of the interaction variables related to object input,
 // adding new objects to the scene in case that the user presses keys 'q' (for boids)
-// or 'r' (for obstacles).
+// or 'r' (for obstacles). Where along the ray they go is drawn from the input
+// stream of the scene by the commands, on the simulation thread, so that the
+// stream only advances when an object is added.
 int
-checkNewObjectsInput(glm::mat4 view_matrix, glm::mat4 projection_matrix,
-					 std::vector<Boid*> &boids, std::vector<glm::vec4> &boids_vertices, std::vector<glm::uvec3> &boids_faces,
-					 std::vector<Obstacle*> &obstacles, std::vector<glm::vec4> &obstacles_vertices, std::vector<glm::uvec3> &obstacles_faces) {
+checkNewObjectsInput(glm::mat4 view_matrix, glm::mat4 projection_matrix) {
 	
 	glm::uvec4 viewport = glm::uvec4(0, 0, window_width, window_height);
 
@@ -355,80 +597,219 @@ checkNewObjectsInput(glm::mat4 view_matrix, glm::mat4 projection_matrix,
 	glm::vec3 world_near_coordinate = glm::unProject(near_coordinate, glm::mat4(1.0f), projection_matrix * view_matrix, viewport);
 	glm::vec3 world_far_coordinate = glm::unProject(far_coordinate, glm::mat4(1.0f), projection_matrix * view_matrix, viewport);
 
-	glm::vec3 direction = glm::normalize(world_far_coordinate - world_near_coordinate);
-
-	float r = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-
-	glm::vec3 position;
-
 	// Insert new boid in scene.
 	if (q_pressed) {
-		position = world_near_coordinate + (world_far_coordinate - world_near_coordinate) * glm::max(r, 0.5f) * 0.05f;
-
-		boids.push_back(new Boid(position.x, position.y, position.z, boids_vertices, boids_faces, boids.size()));
+		bool swarm = q_swarm;
+		int count = swarm_size;
+		float radius = swarm_radius;
+		simulation_thread.post([world_near_coordinate, world_far_coordinate, swarm, count, radius](Scene& scene) {
+			float r = scene.input_random.uniform();
+			glm::vec3 position = world_near_coordinate + (world_far_coordinate - world_near_coordinate) * glm::max(r, 0.5f) * 0.05f;
+			if (swarm) {
+				scene.spawn_boids(count, SpawnRegion(SpawnRegion::kBall, position, glm::vec3(radius)));
+			} else {
+				scene.add_boid(position);
+			}
+		});
 		q_pressed = false;
 		return 1;
 
 	// Insert new obstacle in scene.
 	} else if (r_pressed) {
-		position = world_near_coordinate + (world_far_coordinate - world_near_coordinate) * glm::max(r, 0.5f) * 0.2f;
+		simulation_thread.post([world_near_coordinate, world_far_coordinate](Scene& scene) {
+			scene.add_obstacle(obstaclePosition(world_near_coordinate, world_far_coordinate, scene.input_random));
+		});
+		r_pressed = false;
+		return 2;
+	}
+	return 0;
+}
 
-		// For the case of obstacles, we'll have to check whether the position we got
-		// is within the boundaries.
-		
-		// Attempt to locate the obstacle within the boundary.
-		int no_of_attempts = 0;
-		while (glm::length(position) > 50.0f && no_of_attempts < 20) {
-			r = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-			position = world_near_coordinate + (world_far_coordinate - world_near_coordinate) * glm::max(r, 0.5f) * 0.2f;
-			no_of_attempts ++;
-		}
+// Method that writes the frames recorded by the profiler, if any, to
+// <prefix>.csv and <prefix>.json (a Chrome trace).
+void writeProfile(const std::string& prefix)
+{
+	if (g_profiler.frame_count() == 0) {
+		return;
+	}
+	if (g_profiler.write_csv(prefix + ".csv") && g_profiler.write_trace(prefix + ".json")) {
+		std::cout << "Profile of " << g_profiler.frame_count() << " frames written to "
+		          << prefix << ".csv and " << prefix << ".json\n";
+	} else {
+		std::cerr << "Could not write the profile to " << prefix << ".csv and " << prefix << ".json\n";
+	}
+}
 
-		// If this wasn't possible, we'll position the obstacle in the ray at a distance of 90 from the origin. 
-		if (no_of_attempts == 20) {
-			// We apply the quadratic formula to find the location over the ray
-			// that is at a distance of 90 from the origin.
-			float x, y, z;
-			float a, b, c;
-			glm::vec3 direction = glm::normalize(world_far_coordinate - world_near_coordinate);
+// Method that prints the command line options and exits with failure.
+void exitWithUsage(const char* program)
+{
+	std::cerr << "Usage: " << program << " [--headless] [--steps N] [--boids N] [--obstacles N] [--seed S] [--swarm N]"
+	          << " [--record FILE] [--record-every N] [--quantize] [--compare FILE] [--replay FILE]"
+	          << " [--checkpoint FILE] [--restore FILE] [--export PREFIX] [--export-every N]"
+	          << " [--export-format obj|ply]"
+	          << " [--profile PREFIX] [--tick-rate HZ] [--threads N] [--kernels reference|scalar|sse|avx2]\n";
+	exit(EXIT_FAILURE);
+}
 
-			a = world_near_coordinate.x;
-			b = world_near_coordinate.y;
-			c = world_near_coordinate.z;
+// Methods that return the value of a numeric command line option, or print
+// the usage and exit if `text` is not a number of that type as a whole.
+int parseInt(const char* program, const char* text)
+{
+	char* end;
+	errno = 0;
+	long value = std::strtol(text, &end, 10);
+	if (end == text || *end != '\0' || errno == ERANGE || value < INT_MIN || value > INT_MAX) {
+		std::cerr << "Invalid integer '" << text << "'\n";
+		exitWithUsage(program);
+	}
+	return value;
+}
 
-			x = direction.x;
-			y = direction.y;
-			z = direction.z;
+int parseCount(const char* program, const char* text)
+{
+	int value = parseInt(program, text);
+	if (value < 0) {
+		std::cerr << "Invalid count '" << text << "', it must not be negative\n";
+		exitWithUsage(program);
+	}
+	return value;
+}
 
-			float a_q, b_q, c_q;
+unsigned long long parseUnsigned(const char* program, const char* text)
+{
+	char* end;
+	errno = 0;
+	unsigned long long value = std::strtoull(text, &end, 10);
+	if (end == text || *end != '\0' || errno == ERANGE || text[0] == '-') {
+		std::cerr << "Invalid unsigned integer '" << text << "'\n";
+		exitWithUsage(program);
+	}
+	return value;
+}
 
-			a_q = x*x + y*y + z*z;
-			b_q = 2.0f * (a*x + b*y + c*z);
-			c_q = a*a + b*b + c*c - 80.0f*80.0f;
+double parseDouble(const char* program, const char* text)
+{
+	char* end;
+	errno = 0;
+	double value = std::strtod(text, &end);
+	if (end == text || *end != '\0' || errno == ERANGE) {
+		std::cerr << "Invalid number '" << text << "'\n";
+		exitWithUsage(program);
+	}
+	return value;
+}
 
-			float k;
+int main(int argc, char* argv[])
+{
+	std::string window_title = "Boids";
 
-			// Check if the equation has a solution.
-			// If no solution exists, we'll choose an aribitrary position for the obstacle
-			// (k = 200).
-			if (glm::sqrt(b_q*b_q - 4.0f*a_q*c_q) >= 0.0f) {
-				k = (-b_q + glm::sqrt(b_q*b_q - 4.0f*a_q*c_q)) / (2.0f * a_q);
-			} else {
-				k = 200.0f;
+	// Command line options.
+	bool headless = false;
+	HeadlessOptions headless_options;
+	int initial_boids = 500;
+	int initial_obstacles = 80;
+	std::string restore_path;
+	for (int i = 1; i < argc; i ++) {
+		std::string arg = argv[i];
+		if (arg == "--headless") {
+			headless = true;
+		} else if (arg == "--steps" && i + 1 < argc) {
+			headless_options.steps = parseCount(argv[0], argv[++ i]);
+		} else if (arg == "--boids" && i + 1 < argc) {
+			initial_boids = parseCount(argv[0], argv[++ i]);
+		} else if (arg == "--obstacles" && i + 1 < argc) {
+			initial_obstacles = parseCount(argv[0], argv[++ i]);
+		} else if (arg == "--seed" && i + 1 < argc) {
+			scene.set_seed(parseUnsigned(argv[0], argv[++ i]));
+		} else if (arg == "--swarm" && i + 1 < argc) {
+			swarm_size = glm::max(1, parseInt(argv[0], argv[++ i]));
+		} else if (arg == "--record" && i + 1 < argc) {
+			headless_options.record = argv[++ i];
+		} else if (arg == "--record-every" && i + 1 < argc) {
+			headless_options.record_every = glm::max(1, parseInt(argv[0], argv[++ i]));
+		} else if (arg == "--quantize") {
+			headless_options.quantize = true;
+		} else if (arg == "--compare" && i + 1 < argc) {
+			headless_options.compare = argv[++ i];
+		} else if (arg == "--replay" && i + 1 < argc) {
+			if (!replay.open(argv[++ i]) || replay.frame_count() == 0) {
+				std::cerr << "Cannot replay: " << (replay.error().empty() ? "no frames" : replay.error()) << "\n";
+				exit(EXIT_FAILURE);
+			}
+			replaying = true;
+		} else if (arg == "--export" && i + 1 < argc) {
+			export_prefix = argv[++ i];
+			headless_options.export_prefix = export_prefix;
+		} else if (arg == "--export-every" && i + 1 < argc) {
+			headless_options.export_every = glm::max(1, parseInt(argv[0], argv[++ i]));
+		} else if (arg == "--export-format" && i + 1 < argc) {
+			std::string format = argv[++ i];
+			if (format != "obj" && format != "ply") {
+				std::cerr << "Unknown export format '" << format << "'\n";
+				exit(EXIT_FAILURE);
+			}
+			export_format = format == "ply" ? kPlyFormat : kObjFormat;
+			headless_options.export_format = export_format;
+		} else if (arg == "--checkpoint" && i + 1 < argc) {
+			checkpoint_path = argv[++ i];
+			headless_options.checkpoint = checkpoint_path;
+		} else if (arg == "--restore" && i + 1 < argc) {
+			restore_path = argv[++ i];
+		} else if (arg == "--profile" && i + 1 < argc) {
+			profile_prefix = argv[++ i];
+			g_profiler.set_enabled(true);
+		} else if (arg == "--tick-rate" && i + 1 < argc) {
+			// The simulation thread sleeps for a fraction of a tick, so the
+			// rate must be a positive, finite number of ticks per second.
+			double tick_rate = parseDouble(argv[0], argv[++ i]);
+			if (!(tick_rate > 0.0) || std::isinf(tick_rate)) {
+				std::cerr << "The tick rate must be positive\n";
+				exitWithUsage(argv[0]);
 			}
-			position = world_near_coordinate + direction * k;
+			simulation_clock.set_tick_rate(tick_rate);
+		} else if (arg == "--threads" && i + 1 < argc) {
+			simulation.set_threads(parseCount(argv[0], argv[++ i]));
+		} else if (arg == "--kernels" && i + 1 < argc) {
+			std::string name = argv[++ i];
+			const FlockKernels* kernels = find_kernels(name);
+			if (kernels == nullptr && name != "reference") {
+				std::cerr << "Kernels '" << name << "' are not supported on this CPU\n";
+				exit(EXIT_FAILURE);
+			}
+			simulation.set_kernels(kernels);
+		} else {
+			exitWithUsage(argv[0]);
+		}
+	}
+	std::cout << "Simulation threads: " << simulation.thread_count() << "\n";
+	std::cout << "Flock kernels: " << (simulation.flock_kernels() ? simulation.flock_kernels()->name : "reference") << "\n";
+
+	removal_random = Random(scene.seed, Random::stream(kInputStream, 1));
+
+	// Add boids and obstacles to scene. A restored scene already has them, and
+	// a replay shows the recorded ones instead.
+	if (!restore_path.empty() && !replaying) {
+		std::string error;
+		auto start = std::chrono::steady_clock::now();
+		if (!load_checkpoint(scene, restore_path, error)) {
+			std::cerr << "Cannot restore the checkpoint: " << error << "\n";
+			exit(EXIT_FAILURE);
 		}
+		std::cout << "Restored " << scene.simulation.flock().size() << " boids and " << scene.obstacles.size()
+		          << " obstacles from " << restore_path << " in "
+		          << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+		          << " ms\n";
+	} else if (!replaying) {
+		scene.populate(initial_boids, initial_obstacles);
+	}
 
-		obstacles.push_back(new Obstacle(position.x, position.y, position.z, obstacles_vertices, obstacles_faces));
-		r_pressed = false;
-		return 2;
+	// Without a window, only the simulation runs.
+	if (headless) {
+		int status = run_headless(scene, headless_options);
+		writeProfile(profile_prefix);
+		exit(status);
 	}
-	return 0;
-}
 
-int main(int argc, char* argv[])
-{
-	std::string window_title = "Boids";
 	if (!glfwInit()) exit(EXIT_FAILURE);
 	glfwSetErrorCallback(ErrorCallback);
 
@@ -458,7 +839,6 @@ int main(int argc, char* argv[])
 	// Common setup for boids and obstacles.
 	glm::vec4 light_position = glm::vec4(10.0f, 10.0f, 10.0f, 1.0f);
 	float aspect = 0.0f;
-	float theta = 0.0f;
 
 	// Setup vertex shader.
 	GLuint vertex_shader_id = 0;
@@ -468,32 +848,21 @@ int main(int argc, char* argv[])
 	glCompileShader(vertex_shader_id);
 	CHECK_GL_SHADER_ERROR(vertex_shader_id);
 
-	// Setup geometry shader.
-	GLuint geometry_shader_id = 0;
-	const char* geometry_source_pointer = geometry_shader;
-	CHECK_GL_ERROR(geometry_shader_id = glCreateShader(GL_GEOMETRY_SHADER));
-	CHECK_GL_ERROR(glShaderSource(geometry_shader_id, 1, &geometry_source_pointer, nullptr));
-	glCompileShader(geometry_shader_id);
-	CHECK_GL_SHADER_ERROR(geometry_shader_id);
+	// Setup vertex shader for the boids.
+	GLuint boids_vertex_shader_id = 0;
+	const char* boids_vertex_source_pointer = boids_vertex_shader;
+	CHECK_GL_ERROR(boids_vertex_shader_id = glCreateShader(GL_VERTEX_SHADER));
+	CHECK_GL_ERROR(glShaderSource(boids_vertex_shader_id, 1, &boids_vertex_source_pointer, nullptr));
+	glCompileShader(boids_vertex_shader_id);
+	CHECK_GL_SHADER_ERROR(boids_vertex_shader_id);
 
 	//////////////////////
 	/////   BOIDS   //////
 	//////////////////////
 
-	// Create data structures for the boids.
-	std::vector<Boid*> boids;
-	std::vector<glm::vec4> boids_vertices;
-	std::vector<glm::uvec3> boids_faces;
-
-	// Add boids to scene.
-	// Maximum separation from the origin in each axis.
-	int tam = 40;
-	for (int i = 0; i < 500; i ++) {
-		float rand_x = rand() % (2*tam) - tam;
-		float rand_y = rand() % (2*tam) - tam;
-		float rand_z = rand() % (2*tam) - tam;
-		boids.push_back(new Boid(rand_x, rand_y, rand_z, boids_vertices, boids_faces, i));
-	}
+	// Data structures for the boids. Their state lives in the simulation, and
+	// they are all drawn as instances of one flat-shaded mesh.
+	FlatMesh& boids_mesh = scene.boids_flat;
 
 	// Setup our VAO array.
 	CHECK_GL_ERROR(glGenVertexArrays(kNumVaos, &g_array_objects[0]));
@@ -504,20 +873,30 @@ int main(int argc, char* argv[])
 	// Generate buffer objects
 	CHECK_GL_ERROR(glGenBuffers(kNumVbos, &g_buffer_objects[kBoidsVao][0]));
 
-	// Setup vertex data in a VBO.
+	// Setup the mesh vertices and normals in VBOs. The mesh never changes.
 	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, g_buffer_objects[kBoidsVao][kVertexBuffer]));
-	// NOTE: We do not send anything right now, we just describe it to OpenGL.
 	CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
-				sizeof(float) * boids_vertices.size() * 4, nullptr,
-				GL_STATIC_DRAW));
+				sizeof(float) * boids_mesh.vertices.size() * 4,
+				&boids_mesh.vertices[0], GL_STATIC_DRAW));
 	CHECK_GL_ERROR(glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0));
 	CHECK_GL_ERROR(glEnableVertexAttribArray(0));
 
-	// Setup element array buffer.
-	CHECK_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_buffer_objects[kBoidsVao][kIndexBuffer]));
-	CHECK_GL_ERROR(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-				sizeof(uint32_t) * boids_faces.size() * 3,
-				&boids_faces[0], GL_STATIC_DRAW));
+	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, g_buffer_objects[kBoidsVao][kNormalBuffer]));
+	CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
+				sizeof(float) * boids_mesh.normals.size() * 4,
+				&boids_mesh.normals[0], GL_STATIC_DRAW));
+	CHECK_GL_ERROR(glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, 0));
+	CHECK_GL_ERROR(glEnableVertexAttribArray(3));
+
+	// Setup per-instance positions and orientations. They advance one vertex
+	// attribute per instance; their buffer and offset change every frame (see
+	// the render loop).
+	StreamBuffer boids_instances;
+	std::cout << "Instance streaming: " << (boids_instances.persistent() ? "persistent mapping" : "orphaning") << "\n";
+	CHECK_GL_ERROR(glVertexAttribDivisor(1, 1));
+	CHECK_GL_ERROR(glEnableVertexAttribArray(1));
+	CHECK_GL_ERROR(glVertexAttribDivisor(2, 1));
+	CHECK_GL_ERROR(glEnableVertexAttribArray(2));
 
 	// Setup fragment shader for the boids objects
 	GLuint boids_fragment_shader_id = 0;
@@ -532,12 +911,14 @@ int main(int argc, char* argv[])
 	// Let's create our boids program.
 	GLuint boids_program_id = 0;
 	CHECK_GL_ERROR(boids_program_id = glCreateProgram());
-	CHECK_GL_ERROR(glAttachShader(boids_program_id, vertex_shader_id));
+	CHECK_GL_ERROR(glAttachShader(boids_program_id, boids_vertex_shader_id));
 	CHECK_GL_ERROR(glAttachShader(boids_program_id, boids_fragment_shader_id));
-	CHECK_GL_ERROR(glAttachShader(boids_program_id, geometry_shader_id));
 
 	// Bind attributes.
 	CHECK_GL_ERROR(glBindAttribLocation(boids_program_id, 0, "vertex_position"));
+	CHECK_GL_ERROR(glBindAttribLocation(boids_program_id, 1, "instance_position"));
+	CHECK_GL_ERROR(glBindAttribLocation(boids_program_id, 2, "instance_orientation"));
+	CHECK_GL_ERROR(glBindAttribLocation(boids_program_id, 3, "vertex_normal"));
 	CHECK_GL_ERROR(glBindFragDataLocation(boids_program_id, 0, "fragment_color"));
 	glLinkProgram(boids_program_id);
 	CHECK_GL_PROGRAM_ERROR(boids_program_id);
@@ -557,17 +938,13 @@ int main(int argc, char* argv[])
 	//////   OBSTACLES   //////
 	///////////////////////////
 
-	// Create data structures for the obstacles.
-	std::vector<Obstacle*> obstacles;
-	std::vector<glm::vec4> obstacles_vertices;
-	std::vector<glm::uvec3> obstacles_faces;
-
-	// Add boids to scene.
-	for (int i = 0; i < 80; i ++) {
-		float rand_x = rand() % (2*tam) - tam;
-		float rand_y = rand() % (2*tam) - tam;
-		float rand_z = rand() % (2*tam) - tam;
-		obstacles.push_back(new Obstacle(rand_x, rand_y, rand_z, obstacles_vertices, obstacles_faces));
+	// Data structures for the obstacles. The render thread keeps its own copy
+	// of their geometry, filled by the simulation thread as they are added.
+	FlatMesh obstacles_mesh;
+	DirtyRange obstacles_dirty;
+	if (replaying) {
+		obstacles_mesh.append(replay.obstacle_vertices(), replay.obstacle_faces());
+		obstacles_dirty.mark(0, obstacles_mesh.size());
 	}
 
 	// Switch to the VAO for obstacles.
@@ -577,19 +954,16 @@ int main(int argc, char* argv[])
 	CHECK_GL_ERROR(glGenBuffers(kNumVbos, &g_buffer_objects[kObstaclesVao][0]));
 
 	// Setup vertex data in a VBO.
-	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, g_buffer_objects[kObstaclesVao][kVertexBuffer]));
 	// NOTE: We do not send anything right now, we just describe it to OpenGL.
-	CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
-				sizeof(float) * obstacles_vertices.size() * 4, nullptr,
-				GL_STATIC_DRAW));
+	// Vertices and normals are sent by the render loop as obstacles are added.
+	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, g_buffer_objects[kObstaclesVao][kVertexBuffer]));
 	CHECK_GL_ERROR(glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0));
 	CHECK_GL_ERROR(glEnableVertexAttribArray(0));
-
-	// Setup element array buffer.
-	CHECK_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_buffer_objects[kObstaclesVao][kIndexBuffer]));
-	CHECK_GL_ERROR(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-				sizeof(uint32_t) * obstacles_faces.size() * 3,
-				&obstacles_faces[0], GL_STATIC_DRAW));
+	CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, g_buffer_objects[kObstaclesVao][kNormalBuffer]));
+	CHECK_GL_ERROR(glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, 0));
+	CHECK_GL_ERROR(glEnableVertexAttribArray(3));
+	size_t obstacles_vertices_capacity = 0;
+	size_t obstacles_normals_capacity = 0;
 
 	// Setup fragment shader for the obstacles.
 	GLuint obstacles_fragment_shader_id = 0;
@@ -606,10 +980,10 @@ int main(int argc, char* argv[])
 	CHECK_GL_ERROR(obstacles_program_id = glCreateProgram());
 	CHECK_GL_ERROR(glAttachShader(obstacles_program_id, vertex_shader_id));
 	CHECK_GL_ERROR(glAttachShader(obstacles_program_id, obstacles_fragment_shader_id));
-	CHECK_GL_ERROR(glAttachShader(obstacles_program_id, geometry_shader_id));
 
 	// Bind attributes.
 	CHECK_GL_ERROR(glBindAttribLocation(obstacles_program_id, 0, "vertex_position"));
+	CHECK_GL_ERROR(glBindAttribLocation(obstacles_program_id, 3, "vertex_normal"));
 	CHECK_GL_ERROR(glBindFragDataLocation(obstacles_program_id, 0, "fragment_color"));
 	glLinkProgram(obstacles_program_id);
 	CHECK_GL_PROGRAM_ERROR(obstacles_program_id);
@@ -625,7 +999,24 @@ int main(int argc, char* argv[])
 	CHECK_GL_ERROR(obstacles_light_position_location =
 			glGetUniformLocation(obstacles_program_id, "light_position"));
 
+	// From now on the scene belongs to the simulation thread. Nothing is
+	// simulated during a replay.
+	if (!replaying) {
+		simulation_thread.start();
+	}
+
+	// GPU side of the profiler, and the last time the profile was shown in
+	// the window title.
+	GpuTimer gpu_timer;
+	auto overlay_time = std::chrono::steady_clock::now();
+	bool overlay_shown = false;
+
+	auto frame_start = std::chrono::steady_clock::now();
+	double simulation_busy_at_start = simulation_thread.busy_seconds();
 	while (!glfwWindowShouldClose(window)) {
+		// Hand the GPU times of earlier frames that are ready to the profiler.
+		gpu_timer.collect(g_profiler);
+
 		// Setup some basic window stuff.
 		glfwGetFramebufferSize(window, &window_width, &window_height);
 		glViewport(0, 0, window_width, window_height);
@@ -642,34 +1033,49 @@ int main(int argc, char* argv[])
 		// This function will capture important data from mouse/keyboard events,
 		// which might translate to control actions that can affect
 		// the camera's view matrix.
-		checkInput();
-		
+		{
+			PROFILE_SCOPE("input");
+			checkInput();
+		}
+
 		// Compute the view matrix.
 		glm::mat4 view_matrix = g_camera.get_view_matrix(cAction, fpsMode, dragDirection, magnitude);
 
-		// This function will potentially add new objects to the scene.
-		int objects_changed = checkNewObjectsInput(view_matrix, projection_matrix,
-			            						   boids, boids_vertices, boids_faces,
-			            						   obstacles, obstacles_vertices, obstacles_faces); 
-
-		if (objects_changed == 1) {
-			CHECK_GL_ERROR(glBindVertexArray(g_array_objects[kBoidsVao]));
-			CHECK_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_buffer_objects[kBoidsVao][kIndexBuffer]));
-			CHECK_GL_ERROR(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-						sizeof(uint32_t) * boids_faces.size() * 3,
-						&boids_faces[0], GL_STATIC_DRAW));
-		} else if (objects_changed == 2) {
-			CHECK_GL_ERROR(glBindVertexArray(g_array_objects[kObstaclesVao]));
-			CHECK_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_buffer_objects[kObstaclesVao][kIndexBuffer]));
-			CHECK_GL_ERROR(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-						sizeof(uint32_t) * obstacles_faces.size() * 3,
-						&obstacles_faces[0], GL_STATIC_DRAW));
+		// This function will potentially ask the simulation thread to add new
+		// objects to the scene. New boids only add instances; the geometry of
+		// new obstacles comes back from the simulation thread and is uploaded
+		// when drawn.
+		if (!replaying) {
+			PROFILE_SCOPE("new_objects");
+			checkNewObjectsInput(view_matrix, projection_matrix);
 		}
 
-		// Update boids positions.
-		for (unsigned int i = 0; i < boids.size(); i ++) {
-			boids[i]->update(boids_vertices, boids, obstacles);
+		// Take the latest state of the flock. The simulation thread keeps
+		// ticking at its own rate meanwhile, and the flock is drawn between its
+		// last two ticks, at the time of this frame. The instances are written
+		// straight into this frame's region of the instance buffer.
+		// A replay decodes the recorded frame straight from the mapped file
+		// instead.
+		ProfileScope instances_scope("instances");
+		unsigned int instance_count = 0;
+		if (replaying) {
+			// Show the last frame recorded by the current step, so that runs
+			// recorded every N steps play at their real speed. The replay
+			// starts over after the last recorded step.
+			uint64_t last_step = replay.step(replay.frame_count() - 1);
+			size_t frame = replay.frame_at((uint64_t) replay_position % (last_step + 1));
+			instance_count = replay.boid_count(frame);
+			BoidInstance* instances = (BoidInstance*) boids_instances.map(sizeof(BoidInstance) * instance_count);
+			replay.read_instances(frame, instances);
+		} else {
+			const FlockSnapshot& snapshot = simulation_thread.latest();
+			double since_tick = std::chrono::duration<double>(std::chrono::steady_clock::now() - snapshot.tick_time).count();
+			float alpha = glm::clamp((float) (since_tick / simulation_thread.tick_seconds()), 0.0f, 1.0f);
+			instance_count = snapshot.size();
+			BoidInstance* instances = (BoidInstance*) boids_instances.map(sizeof(BoidInstance) * instance_count);
+			snapshot.interpolate(alpha, instances);
 		}
+		instances_scope.stop();
 
 		/**************
 		 *            *
@@ -677,14 +1083,18 @@ int main(int argc, char* argv[])
 		 *
 		 **************/
 
+		ProfileScope boids_scope("boids_draw");
+		gpu_timer.begin("gpu_boids");
+
 		// Switch to the boids VAO.
 		CHECK_GL_ERROR(glBindVertexArray(g_array_objects[kBoidsVao]));
-		// Send vertices to the GPU.
-		CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER,
-		                            g_buffer_objects[kBoidsVao][kVertexBuffer]));
-		CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
-		                            sizeof(float) * boids_vertices.size() * 4,
-		                            &boids_vertices[0], GL_STATIC_DRAW));
+		// Hand the instances over to the GPU and point the instance attributes
+		// at them.
+		size_t instances_offset = boids_instances.unmap();
+		CHECK_GL_ERROR(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BoidInstance),
+		                                     (void*) (instances_offset + offsetof(BoidInstance, position))));
+		CHECK_GL_ERROR(glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(BoidInstance),
+		                                     (void*) (instances_offset + offsetof(BoidInstance, orientation))));
 
 		// Use boids program.
 		CHECK_GL_ERROR(glUseProgram(boids_program_id));
@@ -696,8 +1106,11 @@ int main(int argc, char* argv[])
 					&view_matrix[0][0]));
 		CHECK_GL_ERROR(glUniform4fv(boids_light_position_location, 1, &light_position[0]));
 
-		// Draw triangles.
-		CHECK_GL_ERROR(glDrawElements(GL_TRIANGLES, boids_faces.size() * 3, GL_UNSIGNED_INT, 0));
+		// Draw one instance of the mesh per boid.
+		CHECK_GL_ERROR(glDrawArraysInstanced(GL_TRIANGLES, 0, boids_mesh.size(), instance_count));
+		gpu_timer.end();
+		boids_instances.fence();
+		boids_scope.stop();
 
 		/******************
 		 *                *
@@ -707,12 +1120,22 @@ int main(int argc, char* argv[])
 
 		// Switch to the obstacles VAO.
 		CHECK_GL_ERROR(glBindVertexArray(g_array_objects[kObstaclesVao]));
-		// Send vertices to the GPU.
+		// Send the vertices and normals added since the last frame to the GPU.
+		ProfileScope upload_scope("obstacles_upload");
+		simulation_thread.take_obstacle_geometry(obstacles_mesh, obstacles_dirty);
 		CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER,
 		                            g_buffer_objects[kObstaclesVao][kVertexBuffer]));
-		CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
-		                            sizeof(float) * obstacles_vertices.size() * 4,
-		                            &obstacles_vertices[0], GL_STATIC_DRAW));
+		uploadDirtyRange(GL_ARRAY_BUFFER, obstacles_mesh.vertices, obstacles_dirty,
+		                 obstacles_vertices_capacity);
+		CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER,
+		                            g_buffer_objects[kObstaclesVao][kNormalBuffer]));
+		uploadDirtyRange(GL_ARRAY_BUFFER, obstacles_mesh.normals, obstacles_dirty,
+		                 obstacles_normals_capacity);
+		obstacles_dirty.clear();
+		upload_scope.stop();
+
+		ProfileScope obstacles_scope("obstacles_draw");
+		gpu_timer.begin("gpu_obstacles");
 
 		// Use obstacles program.
 		CHECK_GL_ERROR(glUseProgram(obstacles_program_id));
@@ -725,12 +1148,55 @@ int main(int argc, char* argv[])
 		CHECK_GL_ERROR(glUniform4fv(obstacles_light_position_location, 1, &light_position[0]));
 
 		// Draw triangles.
-		CHECK_GL_ERROR(glDrawElements(GL_TRIANGLES, obstacles_faces.size() * 3, GL_UNSIGNED_INT, 0));
+		CHECK_GL_ERROR(glDrawArrays(GL_TRIANGLES, 0, obstacles_mesh.size()));
+		gpu_timer.end();
+		obstacles_scope.stop();
 
-		// Poll and swap.
+		// Poll and swap. Until the swap the render thread is working; the
+		// simulation time spent up to there overlapped with it.
 		glfwPollEvents();
-		glfwSwapBuffers(window);
+		auto render_end = std::chrono::steady_clock::now();
+		double simulation_busy_at_render_end = simulation_thread.busy_seconds();
+		{
+			PROFILE_SCOPE("swap");
+			glfwSwapBuffers(window);
+		}
+
+		auto frame_end = std::chrono::steady_clock::now();
+		double simulation_busy_at_end = simulation_thread.busy_seconds();
+		frame_histogram.add(std::chrono::duration<double>(frame_end - frame_start).count());
+		overlap_stats.add(std::chrono::duration<double>(frame_end - frame_start).count(),
+		                  std::chrono::duration<double>(render_end - frame_start).count(),
+		                  simulation_busy_at_end - simulation_busy_at_start,
+		                  simulation_busy_at_render_end - simulation_busy_at_start);
+		if (replaying && !replay_paused) {
+			replay_position += std::chrono::duration<double>(frame_end - frame_start).count() * simulation_clock.tick_rate();
+		}
+		frame_start = frame_end;
+		simulation_busy_at_start = simulation_busy_at_end;
+
+		// Close the profiled frame and show the mean of the phases in the
+		// window title twice a second.
+		g_profiler.end_frame();
+		if (g_profiler.enabled() && frame_end - overlay_time > std::chrono::milliseconds(500)) {
+			std::string title = window_title + " | " + g_profiler.summary();
+			glfwSetWindowTitle(window, title.c_str());
+			overlay_time = frame_end;
+			overlay_shown = true;
+		} else if (!g_profiler.enabled() && overlay_shown) {
+			glfwSetWindowTitle(window, window_title.c_str());
+			overlay_shown = false;
+		}
 	}
+	simulation_thread.stop();
+	geometry_exporter.finish();
+	writeProfile(profile_prefix);
+	std::cout << "Frame times:\n";
+	frame_histogram.report(std::cout);
+	overlap_stats.report(std::cout);
+	simulation_clock.report(std::cout);
+	std::cout << "Instance buffer stalls: " << boids_instances.stalls << "\n";
+	std::cout << "Obstacle geometry uploaded: " << obstacle_upload_bytes << " bytes\n";
 	glfwDestroyWindow(window);
 	glfwTerminate();
 	exit(EXIT_SUCCESS);
@@ -6,19 +6,31 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/norm.hpp> 
 #include <vector>
-#include <random>
+#include "array_view.h"
+#include "random.h"
 
 class Obstacle {
 public:
+	// Number of vertices and faces every Obstacle adds to the scene. They are
+	// contiguous, so the geometry of Obstacle i starts at vertex i * kVertexCount
+	// and face i * kFaceCount.
+	static const unsigned int kVertexCount = 8;
+	static const unsigned int kFaceCount = 12;
+
+	// Constructor method that creates an Obstacle whose state is set afterwards, e.g. when a checkpoint is
+	// restored. Its geometry is not added to the scene.
+	Obstacle() {}
+
 	// Constructor method that creates a new Obstacle whose center is given by the provided x, y, and z coordinates.
-	// The Obstacles's vertices and faces are added to the scene.
-	Obstacle(float x, float y, float z, std::vector<glm::vec4>& vertices, std::vector<glm::uvec3>& faces) {
+	// The Obstacles's vertices and faces are added to the scene. Its size and direction are drawn from `random`.
+	Obstacle(float x, float y, float z, std::vector<glm::vec4>& vertices, std::vector<glm::uvec3>& faces,
+	         Random& random) {
 		center = glm::vec3(x, y, z);
-		side = (float)(rand() % 5 + 4);
+		side = (float)(random.below(5) + 4);
 		radius = glm::sqrt(2.0f) * side / 2.0f; 
 
 		// Generate random front direction.
-		front = glm::normalize(glm::vec3(rand_d(), rand_d(), rand_d()));
+		front = glm::normalize(glm::vec3(rand_d(random), rand_d(random), rand_d(random)));
 
 		// Calculate up.
 		glm::vec3 v = front;
@@ -78,11 +90,10 @@ public:
 	}
 
 	// Custom random function that returns a float between -1 and 1.
-	float rand_d() {
-		return 2.0f * (((double) rand() / (RAND_MAX)) + 1.0) - 1.0f;
+	static float rand_d(Random& random) {
+		return random.uniform(-1.0f, 1.0f);
 	}
 
-	~Obstacle();
 	glm::vec3 center;
 	glm::vec3 front;
 	glm::vec3 up;
@@ -91,4 +102,8 @@ public:
 	float side;
 };
 
+// Read-only view over the obstacles, passed down through the update path
+// without copying the container.
+typedef ArrayView<const Obstacle*> ObstacleView;
+
 #endif
@@ -0,0 +1,211 @@
+#include "obstacle_index.h"
+#include <cstdint>
+
+ObstacleIndex::ObstacleIndex(float cell_size)
+{
+	inverse_cell_size = 1.0f / cell_size;
+}
+
+template <typename Visitor>
+void ObstacleIndex::for_each_bucket(const glm::vec3& center, float radius, Visitor visit) const
+{
+	float reach = 3.0f * radius;
+	int min_x = cell_coordinate(center.x - reach), max_x = cell_coordinate(center.x + reach);
+	int min_y = cell_coordinate(center.y - reach), max_y = cell_coordinate(center.y + reach);
+	int min_z = cell_coordinate(center.z - reach), max_z = cell_coordinate(center.z + reach);
+
+	for (int x = min_x; x <= max_x; x ++) {
+		for (int y = min_y; y <= max_y; y ++) {
+			for (int z = min_z; z <= max_z; z ++) {
+				visit(hash(x, y, z));
+			}
+		}
+	}
+}
+
+void ObstacleIndex::sync(ObstacleView view)
+{
+	unsigned int first = obstacles.size();
+	obstacles.sync(view);
+	if (obstacles.size() == first) {
+		return;
+	}
+
+	if (buckets.empty()) {
+		rebuild(64);
+		return;
+	}
+	for (unsigned int i = first; i < obstacles.size(); i ++) {
+		insert(i);
+	}
+
+	// Keep the table at least twice as large as the number of entries, so
+	// that unrelated cells rarely share a bucket, and reclaim the slots left
+	// behind by growing buckets once they are half of the slots.
+	if (2 * entries > buckets.size()) {
+		rebuild(2 * buckets.size());
+	} else if (2 * unused_slots > slot_obstacle.size()) {
+		rebuild(buckets.size());
+	}
+}
+
+void ObstacleIndex::remove(unsigned int i)
+{
+	unsigned int last = obstacles.size() - 1;
+	glm::vec3 center = glm::vec3(obstacles.x[i], obstacles.y[i], obstacles.z[i]);
+	for_each_bucket(center, obstacles.radius[i], [&](unsigned int b) {
+		const Bucket& bucket = buckets[b];
+		for (unsigned int p = 0; p < bucket.size; p ++) {
+			if (slot_obstacle[bucket.begin + p] == i) {
+				erase_slot(b, p);
+				return;
+			}
+		}
+	});
+	if (i == last) {
+		obstacles.remove(i);
+		return;
+	}
+
+	// The last obstacle becomes obstacle i. Having the highest index, it is at
+	// the back of each of its buckets; move it to where i belongs to keep them
+	// in obstacle order.
+	glm::vec3 moved_center = glm::vec3(obstacles.x[last], obstacles.y[last], obstacles.z[last]);
+	float moved_radius = obstacles.radius[last];
+	obstacles.remove(i);
+	for_each_bucket(moved_center, moved_radius, [&](unsigned int b) {
+		const Bucket& bucket = buckets[b];
+		if (bucket.size == 0 || slot_obstacle[bucket.begin + bucket.size - 1] != last) {
+			return;
+		}
+		erase_slot(b, bucket.size - 1);
+		unsigned int p = bucket.size;
+		while (p > 0 && slot_obstacle[bucket.begin + p - 1] > i) {
+			p --;
+		}
+		insert_slot(b, p, i);
+	});
+}
+
+void ObstacleIndex::insert(unsigned int i)
+{
+	glm::vec3 center = glm::vec3(obstacles.x[i], obstacles.y[i], obstacles.z[i]);
+	for_each_bucket(center, obstacles.radius[i], [&](unsigned int b) {
+		// Cells of the same obstacle may hash to the same bucket. They are
+		// inserted one after the other, so a repeat is always at the back.
+		const Bucket& bucket = buckets[b];
+		if (bucket.size > 0 && slot_obstacle[bucket.begin + bucket.size - 1] == i) {
+			return;
+		}
+		insert_slot(b, bucket.size, i);
+	});
+}
+
+void ObstacleIndex::insert_slot(unsigned int b, unsigned int position, unsigned int i)
+{
+	if (buckets[b].size == buckets[b].capacity) {
+		grow(b);
+	}
+	Bucket& bucket = buckets[b];
+	for (unsigned int s = bucket.begin + bucket.size; s > bucket.begin + position; s --) {
+		copy_slot(s - 1, s);
+	}
+	write_slot(bucket.begin + position, i);
+	bucket.size ++;
+	entries ++;
+}
+
+void ObstacleIndex::erase_slot(unsigned int b, unsigned int position)
+{
+	Bucket& bucket = buckets[b];
+	for (unsigned int s = bucket.begin + position + 1; s < bucket.begin + bucket.size; s ++) {
+		copy_slot(s, s - 1);
+	}
+	bucket.size --;
+	entries --;
+}
+
+void ObstacleIndex::grow(unsigned int b)
+{
+	// Move the bucket to the end of the slots, with twice the room. Its old
+	// slots stay unused until the next rebuild.
+	Bucket& bucket = buckets[b];
+	unsigned int begin = slot_obstacle.size();
+	unsigned int capacity = bucket.capacity > 0 ? 2 * bucket.capacity : 2;
+	resize_slots(begin + capacity);
+	for (unsigned int s = 0; s < bucket.size; s ++) {
+		copy_slot(bucket.begin + s, begin + s);
+	}
+	unused_slots += bucket.capacity;
+	bucket.begin = begin;
+	bucket.capacity = capacity;
+}
+
+void ObstacleIndex::rebuild(unsigned int bucket_count)
+{
+	// Count the entries of every bucket, doubling the table until it is at
+	// least twice as large as their number.
+	std::vector<unsigned int> last_obstacle;
+	do {
+		buckets.assign(bucket_count, Bucket());
+		last_obstacle.assign(bucket_count, UINT32_MAX);
+		mask = bucket_count - 1;
+		entries = 0;
+		for (unsigned int i = 0; i < obstacles.size(); i ++) {
+			glm::vec3 center = glm::vec3(obstacles.x[i], obstacles.y[i], obstacles.z[i]);
+			for_each_bucket(center, obstacles.radius[i], [&](unsigned int b) {
+				if (last_obstacle[b] != i) {
+					last_obstacle[b] = i;
+					buckets[b].size ++;
+					entries ++;
+				}
+			});
+		}
+		bucket_count *= 2;
+	} while (2 * entries > buckets.size());
+
+	// Lay the buckets out with room to grow as much again, then insert
+	// everything again in index order, which keeps buckets sorted.
+	unsigned int slot_count = 0;
+	for (Bucket& bucket : buckets) {
+		bucket.begin = slot_count;
+		bucket.capacity = 2 * bucket.size;
+		bucket.size = 0;
+		slot_count += bucket.capacity;
+	}
+	slot_obstacle.clear();
+	slots = ObstacleArrays();
+	resize_slots(slot_count);
+	unused_slots = 0;
+	entries = 0;
+	for (unsigned int i = 0; i < obstacles.size(); i ++) {
+		insert(i);
+	}
+}
+
+void ObstacleIndex::write_slot(unsigned int slot, unsigned int i)
+{
+	slot_obstacle[slot] = i;
+	slots.x[slot] = obstacles.x[i];
+	slots.y[slot] = obstacles.y[i];
+	slots.z[slot] = obstacles.z[i];
+	slots.radius[slot] = obstacles.radius[i];
+}
+
+void ObstacleIndex::copy_slot(unsigned int from, unsigned int to)
+{
+	slot_obstacle[to] = slot_obstacle[from];
+	slots.x[to] = slots.x[from];
+	slots.y[to] = slots.y[from];
+	slots.z[to] = slots.z[from];
+	slots.radius[to] = slots.radius[from];
+}
+
+void ObstacleIndex::resize_slots(unsigned int count)
+{
+	slot_obstacle.resize(count);
+	slots.x.resize(count);
+	slots.y.resize(count);
+	slots.z.resize(count);
+	slots.radius.resize(count);
+}
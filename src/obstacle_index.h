@@ -0,0 +1,119 @@
+#ifndef OBSTACLE_INDEX_H
+#define OBSTACLE_INDEX_H
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <vector>
+#include "flock_kernels.h"
+#include "obstacle.h"
+
+// Spatial hash over the obstacles' avoidance spheres. Boids only react to an
+// obstacle within 3 * radius of its center, so every obstacle is stored in all
+// the cells overlapped by that sphere's bounding box. A query then looks at the
+// single cell containing the query point instead of at every obstacle.
+//
+// Obstacles never move, so the index is only updated when obstacles are added
+// or removed, and only in the buckets of those obstacles. Buckets are laid out
+// one after the other in flat arrays, each with room to grow: a new obstacle is
+// written into the free slots of its buckets, and a full bucket moves to the
+// end of the arrays with twice the room. The slots left behind are reclaimed
+// once they make up half of the arrays, and the table doubles (re-inserting
+// everything) when it gets too full. Each bucket is kept in obstacle order, so
+// visiting a cell adds contributions in the same order as a scan over every
+// obstacle.
+class ObstacleIndex {
+public:
+	explicit ObstacleIndex(float cell_size = 20.0f);
+
+	// Method that inserts the obstacles added to `obstacles` since the last call.
+	void sync(ObstacleView obstacles);
+
+	// Method that removes obstacle i by moving the last obstacle into its
+	// place, as done to the obstacle array the index was synced with. Only the
+	// buckets of those two obstacles change.
+	void remove(unsigned int i);
+
+	// Method that returns the range [begin, end) of slots of arrays() holding
+	// every obstacle whose avoidance sphere may contain the given point.
+	// Candidates still have to be distance-tested by the caller.
+	void near_range(const glm::vec3& point, unsigned int& begin, unsigned int& end) const {
+		if (buckets.empty()) {
+			begin = end = 0;
+			return;
+		}
+		const Bucket& bucket = buckets[hash(cell_coordinate(point.x), cell_coordinate(point.y),
+		                                    cell_coordinate(point.z))];
+		begin = bucket.begin;
+		end = bucket.begin + bucket.size;
+	}
+
+	// Method that calls `visit(i)`, in increasing order, for every obstacle
+	// whose avoidance sphere may contain the given point.
+	template <typename Visitor>
+	void for_each_near(const glm::vec3& point, Visitor visit) const {
+		unsigned int begin, end;
+		near_range(point, begin, end);
+		for (unsigned int s = begin; s < end; s ++) {
+			visit(slot_obstacle[s]);
+		}
+	}
+
+	// Centers and radii of the obstacles stored in slot order, for the
+	// vectorized kernels.
+	const ObstacleArrays& arrays() const { return slots; }
+
+	unsigned int size() const { return obstacles.size(); }
+
+private:
+	// Slots [begin, begin + size) of the flat arrays hold the obstacles of the
+	// bucket; it can grow up to `capacity` slots in place.
+	struct Bucket {
+		unsigned int begin = 0;
+		unsigned int size = 0;
+		unsigned int capacity = 0;
+	};
+
+	int cell_coordinate(float x) const {
+		return (int) std::floor(x * inverse_cell_size);
+	}
+
+	unsigned int hash(int x, int y, int z) const {
+		// Same primes as SpatialGrid.
+		return (((unsigned int) x * 73856093u) ^
+		        ((unsigned int) y * 19349663u) ^
+		        ((unsigned int) z * 83492791u)) & mask;
+	}
+
+	// Method that calls `visit(b)` for every bucket of the cells overlapped by
+	// the avoidance sphere of an obstacle. A bucket is visited more than once
+	// if several of those cells hash to it.
+	template <typename Visitor>
+	void for_each_bucket(const glm::vec3& center, float radius, Visitor visit) const;
+
+	void insert(unsigned int i);
+	void insert_slot(unsigned int b, unsigned int position, unsigned int i);
+	void erase_slot(unsigned int b, unsigned int position);
+	void grow(unsigned int b);
+	void rebuild(unsigned int bucket_count);
+	void write_slot(unsigned int slot, unsigned int i);
+	void copy_slot(unsigned int from, unsigned int to);
+	void resize_slots(unsigned int count);
+
+	float inverse_cell_size;
+	unsigned int mask = 0;
+	unsigned int entries = 0;
+
+	// Slots no longer used by any bucket, left behind by buckets that grew.
+	unsigned int unused_slots = 0;
+
+	// Every obstacle, in index order.
+	ObstacleArrays obstacles;
+
+	std::vector<Bucket> buckets;
+
+	// Obstacle of every slot, and its center and radius.
+	std::vector<unsigned int> slot_obstacle;
+	ObstacleArrays slots;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "profiler.h"
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+Profiler g_profiler;
+
+namespace {
+	// Small id of the calling thread, in the order threads first record.
+	int thread_index() {
+		static std::atomic<int> next_index(0);
+		static thread_local int index = next_index.fetch_add(1);
+		return index;
+	}
+
+	// Thread id used for GPU intervals in the trace.
+	const int kGpuThread = -1;
+}
+
+Profiler::Profiler()
+{
+	origin = Clock::now();
+	frame_start = origin;
+	summary_totals.assign(1, 0.0);
+}
+
+void Profiler::set_enabled(bool enable)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	frame_start = Clock::now();
+	for (double& seconds : current_frame) {
+		seconds = 0.0;
+	}
+	enabled_flag.store(enable, std::memory_order_relaxed);
+}
+
+void Profiler::record(const char* name, Clock::time_point start, Clock::time_point end)
+{
+	int thread = thread_index();
+	std::lock_guard<std::mutex> lock(mutex);
+	double duration = std::chrono::duration<double>(end - start).count();
+	current_frame[phase(name)] += duration;
+	add_event(name, thread, std::chrono::duration<double>(start - origin).count(), duration);
+}
+
+void Profiler::record_gpu(const char* name, Clock::time_point issued, double seconds)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	current_frame[phase(name)] += seconds;
+	add_event(name, kGpuThread, std::chrono::duration<double>(issued - origin).count(), seconds);
+}
+
+void Profiler::end_frame()
+{
+	if (!enabled()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	Clock::time_point now = Clock::now();
+	std::vector<double> row;
+	row.reserve(current_frame.size() + 1);
+	row.push_back(std::chrono::duration<double>(now - frame_start).count());
+	row.insert(row.end(), current_frame.begin(), current_frame.end());
+	frame_start = now;
+
+	for (unsigned int i = 0; i < row.size(); i ++) {
+		summary_totals[i] += row[i];
+	}
+	summary_frames ++;
+
+	frames.push_back(std::move(row));
+	for (double& seconds : current_frame) {
+		seconds = 0.0;
+	}
+}
+
+size_t Profiler::frame_count() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return frames.size();
+}
+
+std::string Profiler::summary()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2);
+	if (summary_frames > 0) {
+		out << "frame " << 1000.0 * summary_totals[0] / summary_frames << " ms";
+		for (unsigned int i = 0; i < phases.size(); i ++) {
+			out << " | " << phases[i] << " " << 1000.0 * summary_totals[i + 1] / summary_frames;
+		}
+	}
+	for (double& seconds : summary_totals) {
+		seconds = 0.0;
+	}
+	summary_frames = 0;
+	return out.str();
+}
+
+bool Profiler::write_csv(const std::string& path) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::ofstream out(path);
+	if (!out) {
+		return false;
+	}
+	out << "frame,frame_ms";
+	for (const char* name : phases) {
+		out << "," << name << "_ms";
+	}
+	out << "\n";
+
+	// Phases that first ran in a later frame have no column in earlier rows.
+	for (unsigned int f = 0; f < frames.size(); f ++) {
+		out << f;
+		for (unsigned int i = 0; i < phases.size() + 1; i ++) {
+			out << "," << (i < frames[f].size() ? 1000.0 * frames[f][i] : 0.0);
+		}
+		out << "\n";
+	}
+	return (bool) out;
+}
+
+bool Profiler::write_trace(const std::string& path) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::ofstream out(path);
+	if (!out) {
+		return false;
+	}
+	out << std::fixed << std::setprecision(3);
+	out << "{\"traceEvents\":[\n";
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << kGpuThread
+	    << ",\"args\":{\"name\":\"GPU\"}}";
+	for (const Event& event : events) {
+		// Chrome traces count time in microseconds.
+		out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+		    << ",\"ts\":" << 1e6 * event.start << ",\"dur\":" << 1e6 * event.duration << "}";
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" << dropped_events << "}}\n";
+	return (bool) out;
+}
+
+unsigned int Profiler::phase(const char* name)
+{
+	for (unsigned int i = 0; i < phases.size(); i ++) {
+		if (phases[i] == name || std::strcmp(phases[i], name) == 0) {
+			return i;
+		}
+	}
+	phases.push_back(name);
+	current_frame.push_back(0.0);
+	summary_totals.resize(phases.size() + 1, 0.0);
+	return phases.size() - 1;
+}
+
+void Profiler::add_event(const char* name, int thread, double start, double duration)
+{
+	if (events.size() >= kMaxEvents) {
+		dropped_events ++;
+		return;
+	}
+	events.push_back(Event{name, thread, start, duration});
+}
@@ -0,0 +1,118 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Frame profiler. Code marks the phases of a frame with PROFILE_SCOPE, on any
+// thread; the profiler adds up the time of every phase per frame, keeps the
+// individual intervals for a trace, and also takes GPU times measured
+// elsewhere. The results can be written as CSV (one row per frame, one column
+// per phase) and as a Chrome trace_event JSON file (chrome://tracing or
+// Perfetto).
+//
+// While disabled, a scope costs one relaxed atomic load.
+class Profiler {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	Profiler();
+
+	void set_enabled(bool enable);
+	bool enabled() const { return enabled_flag.load(std::memory_order_relaxed); }
+
+	// Method that records that the phase `name` ran from `start` to `end` on
+	// the calling thread. `name` must be a string literal.
+	void record(const char* name, Clock::time_point start, Clock::time_point end);
+
+	// Method that records that the GPU spent `seconds` on the phase `name`,
+	// whose commands were issued at `issued`. GPU times arrive a few frames
+	// late, and are counted in the frame that receives them.
+	void record_gpu(const char* name, Clock::time_point issued, double seconds);
+
+	// Method that closes the current frame.
+	void end_frame();
+
+	// Number of frames recorded so far.
+	size_t frame_count() const;
+
+	// Method that returns the mean time per frame of every phase since the
+	// last call, as a single line.
+	std::string summary();
+
+	// Methods that write every frame recorded so far. They return false if
+	// the file cannot be written.
+	bool write_csv(const std::string& path) const;
+	bool write_trace(const std::string& path) const;
+
+private:
+	struct Event {
+		const char* name;
+		int thread;  // -1 for the GPU.
+		double start;  // Seconds since the profiler was created.
+		double duration;
+	};
+
+	// Method that returns the column of the given phase, adding it if needed.
+	unsigned int phase(const char* name);
+	void add_event(const char* name, int thread, double start, double duration);
+
+	// Most intervals kept for the trace; later ones only count in the totals.
+	static const size_t kMaxEvents = 1 << 20;
+
+	std::atomic<bool> enabled_flag{false};
+	mutable std::mutex mutex;
+	Clock::time_point origin;
+	Clock::time_point frame_start;
+
+	std::vector<const char*> phases;
+	std::vector<double> current_frame;  // Seconds per phase in this frame.
+	std::vector<std::vector<double>> frames;  // Frame time, then every phase.
+	std::vector<Event> events;
+	unsigned long long dropped_events = 0;
+
+	std::vector<double> summary_totals;
+	unsigned long long summary_frames = 0;
+};
+
+// Profiler shared by the whole program.
+extern Profiler g_profiler;
+
+// Timer that records the time between its construction and its destruction
+// as the phase `name`, when the profiler is enabled.
+class ProfileScope {
+public:
+	explicit ProfileScope(const char* name) {
+		this->name = g_profiler.enabled() ? name : nullptr;
+		if (this->name != nullptr) {
+			start = Profiler::Clock::now();
+		}
+	}
+
+	~ProfileScope() {
+		stop();
+	}
+
+	// Method that ends the phase before the end of the block.
+	void stop() {
+		if (name != nullptr) {
+			g_profiler.record(name, start, Profiler::Clock::now());
+			name = nullptr;
+		}
+	}
+
+private:
+	const char* name;
+	Profiler::Clock::time_point start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+// Macro that times the rest of the enclosing block as the phase `name`.
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Kinds of random streams. Every entity gets its own stream of each kind, so
+// the numbers it draws do not depend on what other entities drew before it.
+enum RandomDomain {
+	kBoidStream,
+	kObstacleStream,
+	kInputStream,
+};
+
+// Counter-based random number generator: the n-th number of a stream is a hash
+// of the seed, the stream id and n, so streams need no shared state and can be
+// created and consumed in any order and on any thread. The hash is the
+// SplitMix64 finalizer.
+class Random {
+public:
+	Random(uint64_t seed = 0, uint64_t stream = 0) {
+		key = mix(seed + mix(stream + kGolden));
+		counter = 0;
+	}
+
+	// Method that returns the id of the stream of the given domain for the
+	// entity with the given index. Each domain offsets the index by a hash of
+	// its own, so indices never repeat within a domain and the domains are
+	// far apart.
+	static uint64_t stream(RandomDomain domain, uint64_t index) {
+		return mix(((uint64_t) domain + 1) * kGolden) + index;
+	}
+
+	// Method that returns the next 32 random bits of the stream.
+	uint32_t next() {
+		counter ++;
+		return (uint32_t) (mix(key + counter * kGolden) >> 32);
+	}
+
+	// Method that returns a float uniformly distributed in [0, 1).
+	float uniform() {
+		return (next() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// Method that returns a float uniformly distributed in [low, high).
+	float uniform(float low, float high) {
+		return low + (high - low) * uniform();
+	}
+
+	// Method that returns an integer uniformly distributed in [0, n).
+	uint32_t below(uint32_t n) {
+		return (uint32_t) (((uint64_t) next() * n) >> 32);
+	}
+
+	// Key of the stream and number of values drawn from it; together they are
+	// the whole state of the generator.
+	uint64_t key;
+	uint64_t counter;
+
+private:
+	static constexpr uint64_t kGolden = 0x9e3779b97f4a7c15ull;
+
+	static uint64_t mix(uint64_t z) {
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+};
+
+#endif
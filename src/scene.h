@@ -0,0 +1,301 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+#include "boid.h"
+#include "entity_handles.h"
+#include "flat_mesh.h"
+#include "obstacle.h"
+#include "random.h"
+#include "simulation.h"
+
+// Range [begin, end) of the elements of a scene array that changed since the
+// array was last sent to the GPU.
+class DirtyRange {
+public:
+	// Method that adds the elements [first, last) to the range.
+	void mark(unsigned int first, unsigned int last) {
+		if (!dirty()) {
+			begin = first;
+			end = last;
+			return;
+		}
+		begin = first < begin ? first : begin;
+		end = last > end ? last : end;
+	}
+
+	bool dirty() const { return begin < end; }
+
+	void clear() { begin = end = 0; }
+
+	unsigned int begin = 0;
+	unsigned int end = 0;
+};
+
+// Region new Boids are spread over, uniformly: the box [center - extent,
+// center + extent], or the ellipsoid (a ball if every extent is the same)
+// inscribed in it.
+struct SpawnRegion {
+	enum Shape {
+		kBox,
+		kBall,
+	};
+
+	SpawnRegion(Shape shape = kBox, const glm::vec3& center = glm::vec3(0.0f), const glm::vec3& extent = glm::vec3(40.0f))
+		: shape(shape), center(center), extent(extent) {}
+
+	// Method that draws a point of the region from `random`.
+	glm::vec3 sample(Random& random) const {
+		if (shape == kBall) {
+			glm::vec3 p;
+			do {
+				p.x = random.uniform(-1.0f, 1.0f);
+				p.y = random.uniform(-1.0f, 1.0f);
+				p.z = random.uniform(-1.0f, 1.0f);
+			} while (glm::dot(p, p) > 1.0f);
+			return center + p * extent;
+		}
+		glm::vec3 p;
+		p.x = center.x + random.uniform(-extent.x, extent.x);
+		p.y = center.y + random.uniform(-extent.y, extent.y);
+		p.z = center.z + random.uniform(-extent.z, extent.z);
+		return p;
+	}
+
+	Shape shape;
+	glm::vec3 center;
+	glm::vec3 extent;
+};
+
+// Everything that is simulated and drawn: the flock, the obstacles, the mesh
+// every Boid is drawn with, and the vertices and faces of the obstacles. Both
+// meshes are also kept flat-shaded for drawing. It does not depend on OpenGL,
+// so the same scene can be simulated with or without a window. Obstacle
+// geometry never changes once added, so the scene tracks which part of it
+// still has to be uploaded.
+//
+// Every random number comes from the stream of the entity it is drawn for,
+// keyed by the scene's seed and the number of entities of its kind spawned
+// before it, so the same seed always produces the same scene.
+//
+// Boids and obstacles are stored packed, and removed in O(1) by moving the
+// last one into the hole. Handles keep referring to the same entity wherever
+// it is moved.
+class Scene {
+public:
+	Scene() {
+		Boid::mesh(boids_vertices, boids_faces);
+		boids_flat.append(boids_vertices, boids_faces);
+		set_seed(1);
+	}
+
+	// Method that sets the seed of every random stream of the scene. It only
+	// affects entities added afterwards.
+	void set_seed(uint64_t seed) {
+		this->seed = seed;
+		input_random = Random(seed, Random::stream(kInputStream, 0));
+	}
+
+	// Method that adds a new Boid centered at the given position.
+	EntityHandle add_boid(const glm::vec3& position) {
+		Random random = boid_random();
+		return spawn_boid(position, random);
+	}
+
+	// Method that adds a new Obstacle centered at the given position.
+	EntityHandle add_obstacle(const glm::vec3& position) {
+		Random random = obstacle_random();
+		return spawn_obstacle(position, random);
+	}
+
+	// Method that adds `count` Boids spread over the given region and returns
+	// the index of the first one; the others follow it. The flock grows once,
+	// and the Boids are initialized in parallel, each from its own stream, so
+	// the result does not depend on the number of threads.
+	unsigned int spawn_boids(unsigned int count, const SpawnRegion& region) {
+		FlockStorage& flock = simulation.flock();
+		unsigned int first = flock.size();
+		uint64_t first_stream = boids_spawned;
+		boids_spawned += count;
+
+		flock.position.resize(first + count);
+		flock.velocity.resize(first + count);
+		flock.orientation.resize(first + count);
+		auto initialize = [&](unsigned int begin, unsigned int end) {
+			for (unsigned int i = begin; i < end; i ++) {
+				Random random(seed, Random::stream(kBoidStream, first_stream + i));
+				flock.position[first + i] = region.sample(random);
+				Boid::random_motion(random, flock.velocity[first + i], flock.orientation[first + i]);
+			}
+		};
+		simulation.parallel_for(count, 1024, initialize);
+
+		for (unsigned int i = 0; i < count; i ++) {
+			boid_handles.add();
+		}
+		return first;
+	}
+
+	// Method that removes the Boid of the given handle. Returns false if the
+	// handle is no longer valid.
+	bool remove_boid(EntityHandle handle) {
+		if (!boid_handles.valid(handle)) {
+			return false;
+		}
+		unsigned int i = boid_handles.index(handle);
+		simulation.remove_boid(i);
+		boid_handles.remove(i);
+		return true;
+	}
+
+	// Method that removes the Obstacle of the given handle, together with its
+	// geometry. The last Obstacle and its geometry are moved into the hole, so
+	// only that part of the flat mesh has to be uploaded again, and only the
+	// entries of those two obstacles change in the obstacle indices. Returns
+	// false if the handle is no longer valid.
+	bool remove_obstacle(EntityHandle handle) {
+		if (!obstacle_handles.valid(handle)) {
+			return false;
+		}
+		unsigned int i = obstacle_handles.index(handle);
+		unsigned int last = obstacles.size() - 1;
+		simulation.remove_obstacle(obstacles, i);
+
+		obstacle_storage[i] = obstacle_storage[last];
+		obstacle_storage.pop_back();
+		obstacles.pop_back();
+
+		// Move the vertices, then the faces, which index them.
+		unsigned int shift = (last - i) * Obstacle::kVertexCount;
+		for (unsigned int v = 0; v < Obstacle::kVertexCount; v ++) {
+			obstacles_vertices[i * Obstacle::kVertexCount + v] = obstacles_vertices[last * Obstacle::kVertexCount + v];
+		}
+		for (unsigned int f = 0; f < Obstacle::kFaceCount; f ++) {
+			obstacles_faces[i * Obstacle::kFaceCount + f] = obstacles_faces[last * Obstacle::kFaceCount + f] -
+			                                                glm::uvec3(shift);
+		}
+		obstacles_vertices.resize(last * Obstacle::kVertexCount);
+		obstacles_faces.resize(last * Obstacle::kFaceCount);
+
+		// Every face has its own three flat vertices.
+		unsigned int flat_count = 3 * Obstacle::kFaceCount;
+		for (unsigned int v = 0; v < flat_count; v ++) {
+			obstacles_flat.vertices[i * flat_count + v] = obstacles_flat.vertices[last * flat_count + v];
+			obstacles_flat.normals[i * flat_count + v] = obstacles_flat.normals[last * flat_count + v];
+		}
+		obstacles_flat.vertices.resize(last * flat_count);
+		obstacles_flat.normals.resize(last * flat_count);
+		if (i < last) {
+			obstacles_flat_dirty.mark(i * flat_count, (i + 1) * flat_count);
+		}
+
+		obstacle_handles.remove(i);
+		return true;
+	}
+
+	// Method that adds the given number of boids and obstacles at random
+	// positions, at most `tam` units away from the origin in each axis.
+	// Negative counts add nothing.
+	void populate(int boid_count, int obstacle_count, int tam = 40) {
+		spawn_boids(boid_count > 0 ? boid_count : 0, SpawnRegion(SpawnRegion::kBox, glm::vec3(0.0f), glm::vec3(tam)));
+
+		for (int i = 0; i < obstacle_count; i ++) {
+			Random random = obstacle_random();
+			spawn_obstacle(random_position(random, tam), random);
+		}
+	}
+
+	// Method that rebuilds everything derived from the flock, the obstacles and
+	// their geometry after they were replaced as a whole, e.g. when a
+	// checkpoint is restored. The flat obstacle mesh is rebuilt and marked to
+	// be uploaded again in full, and every handle is invalidated.
+	void rebuild() {
+		obstacles_flat = FlatMesh();
+		obstacles_flat.append(obstacles_vertices, obstacles_faces);
+		obstacles_flat_dirty.clear();
+		obstacles_flat_dirty.mark(0, obstacles_flat.size());
+		boid_handles.reset(simulation.flock().size());
+		obstacle_handles.reset(obstacles.size());
+		simulation.restart();
+	}
+
+	// Method that advances the simulation by one tick, writing the instances to
+	// draw the flock with to `instances` if given.
+	void step(BoidInstance* instances = nullptr) {
+		simulation.step(obstacles, instances);
+	}
+
+	Simulation simulation;
+
+	// Seed of the scene, and stream used to place the entities added by the user.
+	// Like the rest of the scene, the stream is only used on the thread that
+	// simulates it, so checkpoints save it consistently.
+	uint64_t seed;
+	Random input_random;
+
+	// Boid mesh in model space (see Boid::mesh).
+	std::vector<glm::vec4> boids_vertices;
+	std::vector<glm::uvec3> boids_faces;
+	FlatMesh boids_flat;
+
+	std::vector<Obstacle*> obstacles;
+
+	// Storage of the obstacles pointed to by `obstacles`. Its elements never
+	// move, and it allocates them in blocks rather than one by one.
+	std::deque<Obstacle> obstacle_storage;
+
+	std::vector<glm::vec4> obstacles_vertices;
+	std::vector<glm::uvec3> obstacles_faces;
+	FlatMesh obstacles_flat;
+
+	// Flat obstacle vertices changed since the last upload. The mesh may also
+	// have shrunk since then.
+	DirtyRange obstacles_flat_dirty;
+
+	// Handles of the Boids (in flock order) and of the Obstacles.
+	HandleTable boid_handles;
+	HandleTable obstacle_handles;
+
+	// Number of Boids and Obstacles spawned so far, including removed ones.
+	// Each new entity draws from the stream of its number.
+	uint64_t boids_spawned = 0;
+	uint64_t obstacles_spawned = 0;
+
+private:
+	// Method that returns the stream of the next Boid to be added.
+	Random boid_random() {
+		return Random(seed, Random::stream(kBoidStream, boids_spawned ++));
+	}
+
+	// Method that returns the stream of the next Obstacle to be added.
+	Random obstacle_random() {
+		return Random(seed, Random::stream(kObstacleStream, obstacles_spawned ++));
+	}
+
+	static glm::vec3 random_position(Random& random, int tam) {
+		float rand_x = random.uniform(-tam, tam);
+		float rand_y = random.uniform(-tam, tam);
+		float rand_z = random.uniform(-tam, tam);
+		return glm::vec3(rand_x, rand_y, rand_z);
+	}
+
+	EntityHandle spawn_boid(const glm::vec3& position, Random& random) {
+		Boid::spawn(simulation.flock(), position.x, position.y, position.z, random);
+		return boid_handles.add();
+	}
+
+	EntityHandle spawn_obstacle(const glm::vec3& position, Random& random) {
+		unsigned int first_face = obstacles_faces.size();
+		unsigned int first_flat_vertex = obstacles_flat.size();
+		obstacle_storage.emplace_back(position.x, position.y, position.z, obstacles_vertices, obstacles_faces, random);
+		obstacles.push_back(&obstacle_storage.back());
+		obstacles_flat.append(obstacles_vertices, obstacles_faces, first_face);
+		obstacles_flat_dirty.mark(first_flat_vertex, obstacles_flat.size());
+		return obstacle_handles.add();
+	}
+};
+
+#endif
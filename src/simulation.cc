@@ -0,0 +1,122 @@
+#include "simulation.h"
+#include <thread>
+#include "profiler.h"
+
+int Simulation::thread_count() const
+{
+	if (threads > 0) {
+		return threads;
+	}
+	int hardware_threads = std::thread::hardware_concurrency();
+	return hardware_threads > 0 ? hardware_threads : 1;
+}
+
+JobSystem& Simulation::workers()
+{
+	if (!job_system || job_system->worker_count() != thread_count()) {
+		job_system.reset(new JobSystem(thread_count()));
+	}
+	return *job_system;
+}
+
+void Simulation::restart()
+{
+	state[1 - current] = state[current];
+	obstacle_index = ObstacleIndex();
+	obstacle_arrays = ObstacleArrays();
+}
+
+void Simulation::remove_boid(unsigned int i)
+{
+	FlockStorage& now = state[current];
+	FlockStorage& before = state[1 - current];
+
+	// Boids spawned since the last step are only in the current frame. If the
+	// Boid moved into place i is one of them, it has no previous state either,
+	// so it is drawn where it is now.
+	bool stepped = before.size() == now.size();
+	now.remove(i);
+	if (stepped) {
+		before.remove(i);
+	} else if (i < before.size() && i < now.size()) {
+		before.position[i] = now.position[i];
+		before.velocity[i] = now.velocity[i];
+		before.orientation[i] = now.orientation[i];
+	}
+}
+
+void Simulation::remove_obstacle(ObstacleView obstacles, unsigned int i)
+{
+	// The indices only hold the obstacles up to the last step. If obstacle i
+	// is among them, bring them up to date first, so that their last obstacle
+	// is the one moved into place i. Otherwise the indices do not change: the
+	// next step picks up the obstacle moved into place i as a new one.
+	if (i < obstacle_index.size()) {
+		obstacle_index.sync(obstacles);
+		obstacle_index.remove(i);
+	}
+	if (i < obstacle_arrays.size()) {
+		obstacle_arrays.sync(obstacles);
+		obstacle_arrays.remove(i);
+	}
+}
+
+void Simulation::step(ObstacleView obstacles, BoidInstance* instances)
+{
+	const FlockStorage& read = state[current];
+	FlockStorage& write = state[1 - current];
+
+	ProfileScope index_scope("neighbor_index");
+
+	// Boids spawned since the last step only exist in the current buffer; bring
+	// the other one up to date. Apart from creating the job system, this is the
+	// only place where a step allocates.
+	if (write.size() != read.size()) {
+		write = read;
+	}
+
+	// Bucket boids by position so the flock rules only look at nearby cells.
+	const SpatialGrid* neighbors = nullptr;
+	if (use_spatial_grid) {
+		grid.rebuild(read.size(), [&](unsigned int i) { return read.position[i]; });
+		neighbors = &grid;
+	}
+
+	// Index the obstacles added since the last step.
+	const ObstacleIndex* near_obstacles = nullptr;
+	if (use_obstacle_index) {
+		obstacle_index.sync(obstacles);
+		near_obstacles = &obstacle_index;
+	}
+
+	// Flat copies of the flock and the obstacles for the vectorized kernels.
+	if (kernels != nullptr) {
+		neighbor_arrays.gather(read, neighbors);
+		obstacle_arrays.sync(obstacles);
+	}
+
+	index_scope.stop();
+
+	// Every Boid reads frame N and writes its own entry of frame N+1, so
+	// iterations are independent. Each Boid is computed entirely by one thread,
+	// hence results do not depend on how the loop is split. Chunks are balanced
+	// by work stealing because the cost of a Boid grows with the number of
+	// flockmates around it.
+	auto update_range = [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i ++) {
+			if (kernels != nullptr) {
+				Boid(read, i).update(write, *kernels, neighbor_arrays, obstacle_arrays, neighbors, near_obstacles);
+			} else {
+				Boid(read, i).update(write, obstacles, neighbors, near_obstacles);
+			}
+			if (instances != nullptr) {
+				instances[i].position = write.position[i];
+				instances[i].orientation = write.orientation[i];
+			}
+		}
+	};
+	PROFILE_SCOPE("flock_update");
+	workers().parallel_for(read.size(), 64, update_range);
+
+	current = 1 - current;
+}
@@ -0,0 +1,100 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+#include "boid.h"
+#include "flock_kernels.h"
+#include "job_system.h"
+#include "flock_storage.h"
+#include "obstacle_index.h"
+#include "spatial_grid.h"
+
+// Double-buffered flock simulation. Every step reads the state of frame N from
+// one FlockStorage and writes frame N+1 into the other, then swaps them. Boids
+// therefore never observe a partially updated flock, and the result of a step
+// does not depend on the order in which Boids are updated. This is what lets
+// the step run on several threads while staying bitwise identical to a serial
+// run, whatever the thread count.
+class Simulation {
+public:
+	Simulation() : grid(Boid::neighbor_radius) {}
+
+	// State of the current frame. New Boids are spawned into it.
+	FlockStorage& flock() { return state[current]; }
+	const FlockStorage& flock() const { return state[current]; }
+
+	// State of the previous frame, for the Boids that took part in the last
+	// step. It is overwritten by the next step.
+	const FlockStorage& previous_flock() const { return state[1 - current]; }
+
+	// Method that makes the current flock and obstacles the starting point of
+	// the simulation after they were replaced as a whole, e.g. when a
+	// checkpoint is restored. The previous frame becomes a copy of the current
+	// one, and the obstacle indices are rebuilt by the next step.
+	void restart();
+
+	// Method that removes Boid i from the current and the previous frame, by
+	// moving the last Boid into its place (see FlockStorage::remove).
+	void remove_boid(unsigned int i);
+
+	// Method that removes obstacle i from the obstacle indices, before the
+	// last of the given obstacles is moved into its place. Only the entries of
+	// those two obstacles change.
+	void remove_obstacle(ObstacleView obstacles, unsigned int i);
+
+	// Method that advances the flock by one tick. If `instances` is given, the
+	// new position and orientation of every Boid are also written there as it
+	// is updated (e.g. straight into mapped GPU memory), so drawing the flock
+	// needs no separate copy.
+	void step(ObstacleView obstacles, BoidInstance* instances = nullptr);
+
+	// Method that sets the number of threads used by step(). Zero uses every
+	// hardware thread.
+	void set_threads(int count) { threads = count; }
+	int thread_count() const;
+
+	// Job system the steps run on, created by the first step. Its per-worker
+	// statistics describe how the work was balanced.
+	JobSystem* jobs() { return job_system.get(); }
+
+	// Method that runs `body(begin, end)` over [0, size) on the workers of the
+	// steps, between two steps, e.g. to initialize many Boids at once.
+	template <typename Body>
+	void parallel_for(unsigned int size, unsigned int chunk, Body& body) {
+		workers().parallel_for(size, chunk, body);
+	}
+
+	// Method that selects the vectorized kernels used for the neighbor and
+	// obstacle loops, or the reference per-Boid rules if nullptr. By default
+	// the fastest kernels supported by the CPU are used.
+	void set_kernels(const FlockKernels* selected) { kernels = selected; }
+	const FlockKernels* flock_kernels() const { return kernels; }
+
+	// Whether neighbor queries go through the spatial grid (true) or scan the
+	// whole flock (false).
+	bool use_spatial_grid = true;
+
+	// Whether obstacle avoidance looks up obstacles through the obstacle index
+	// (true) or tests every obstacle (false).
+	bool use_obstacle_index = true;
+
+private:
+	// Method that returns the job system, (re)creating the workers when the
+	// thread count changed.
+	JobSystem& workers();
+
+	FlockStorage state[2];
+	int current = 0;
+	int threads = 0;
+	std::unique_ptr<JobSystem> job_system;
+	SpatialGrid grid;
+	ObstacleIndex obstacle_index;
+
+	const FlockKernels* kernels = &best_kernels();
+	NeighborArrays neighbor_arrays;
+	ObstacleArrays obstacle_arrays;
+};
+
+#endif
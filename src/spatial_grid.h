@@ -0,0 +1,146 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+
+// Uniform spatial hash grid used to answer "which agents are near this point"
+// queries without scanning the whole flock. The grid is rebuilt from scratch
+// every tick: agents are bucketed by the cell that contains them (counting sort),
+// so a query only visits the 27 cells around the query point.
+//
+// The cell size must be at least the query radius; with a cell size equal to the
+// radius, every agent within that radius is guaranteed to be in one of the 27 cells.
+class SpatialGrid {
+public:
+	SpatialGrid(float cell_size = 10.0f) {
+		this->cell_size = cell_size;
+		inverse_cell_size = 1.0f / cell_size;
+	}
+
+	// Method that rebuilds the grid for `count` agents. `position(i)` must return the
+	// position of agent i. Buffers are reused between rebuilds, so once the flock
+	// stops growing no memory is allocated.
+	template <typename PositionAccessor>
+	void rebuild(unsigned int count, PositionAccessor position) {
+		// Table size is a power of two at least twice the number of agents, so that
+		// the hash can be reduced with a mask and collisions stay rare.
+		unsigned int table_size = 64;
+		while (table_size < 2 * count) {
+			table_size *= 2;
+		}
+		mask = table_size - 1;
+
+		cell_start.assign(table_size + 1, 0);
+		agent_cell.resize(count);
+		sorted_agents.resize(count);
+
+		// Count agents per bucket.
+		for (unsigned int i = 0; i < count; i ++) {
+			agent_cell[i] = bucket_of(position(i));
+			cell_start[agent_cell[i] + 1] ++;
+		}
+
+		// Prefix sum: cell_start[b] is the first slot of bucket b.
+		for (unsigned int b = 0; b < table_size; b ++) {
+			cell_start[b + 1] += cell_start[b];
+		}
+
+		// Scatter agent indices into their buckets. Iterating in index order keeps
+		// every bucket sorted by agent index.
+		cursor.assign(cell_start.begin(), cell_start.end() - 1);
+		for (unsigned int i = 0; i < count; i ++) {
+			sorted_agents[cursor[agent_cell[i]] ++] = i;
+		}
+	}
+
+	// Method that calls `visit(i)` once for every agent stored in the 27 cells
+	// surrounding the given point. Candidates still have to be distance-tested
+	// by the caller.
+	template <typename Visitor>
+	void for_each_near(const glm::vec3& point, Visitor visit) const {
+		for_each_near_range(point, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int s = begin; s < end; s ++) {
+				visit(sorted_agents[s]);
+			}
+		});
+	}
+
+	// Method that calls `visit(begin, end)` for every non-empty bucket among the
+	// 27 cells surrounding the given point, where [begin, end) is a range of
+	// slots in order(). Agents of a bucket occupy consecutive slots, so data
+	// stored in slot order can be processed a whole bucket at a time.
+	template <typename RangeVisitor>
+	void for_each_near_range(const glm::vec3& point, RangeVisitor visit) const {
+		if (sorted_agents.empty()) {
+			return;
+		}
+
+		int cx = cell_coordinate(point.x);
+		int cy = cell_coordinate(point.y);
+		int cz = cell_coordinate(point.z);
+
+		// Different cells may hash to the same bucket; remember which buckets were
+		// already visited so no agent is reported twice.
+		unsigned int visited[27];
+		int visited_count = 0;
+
+		for (int dx = -1; dx <= 1; dx ++) {
+			for (int dy = -1; dy <= 1; dy ++) {
+				for (int dz = -1; dz <= 1; dz ++) {
+					unsigned int bucket = hash(cx + dx, cy + dy, cz + dz);
+
+					bool seen = false;
+					for (int k = 0; k < visited_count; k ++) {
+						if (visited[k] == bucket) {
+							seen = true;
+							break;
+						}
+					}
+					if (seen) {
+						continue;
+					}
+					visited[visited_count ++] = bucket;
+
+					if (cell_start[bucket] < cell_start[bucket + 1]) {
+						visit(cell_start[bucket], cell_start[bucket + 1]);
+					}
+				}
+			}
+		}
+	}
+
+	// Agent indices sorted by bucket: slot s holds agent order()[s].
+	const std::vector<unsigned int>& order() const {
+		return sorted_agents;
+	}
+
+	float cell_size;
+
+private:
+	int cell_coordinate(float x) const {
+		return (int) std::floor(x * inverse_cell_size);
+	}
+
+	unsigned int hash(int x, int y, int z) const {
+		// Large primes from Teschner et al., "Optimized Spatial Hashing for
+		// Collision Detection of Deformable Objects".
+		return (((unsigned int) x * 73856093u) ^
+		        ((unsigned int) y * 19349663u) ^
+		        ((unsigned int) z * 83492791u)) & mask;
+	}
+
+	unsigned int bucket_of(const glm::vec3& p) const {
+		return hash(cell_coordinate(p.x), cell_coordinate(p.y), cell_coordinate(p.z));
+	}
+
+	float inverse_cell_size;
+	unsigned int mask = 0;
+	std::vector<unsigned int> cell_start;
+	std::vector<unsigned int> cursor;
+	std::vector<unsigned int> agent_cell;
+	std::vector<unsigned int> sorted_agents;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "stream_buffer.h"
+#include <GLFW/glfw3.h>
+#include <debuggl.h>
+#include <iostream>
+
+namespace {
+	const GLbitfield kPersistentFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const size_t kMinimumRegionSize = 64 * 1024;
+}
+
+StreamBuffer::StreamBuffer(GLenum target)
+{
+	this->target = target;
+	persistent_mapping = GLEW_ARB_buffer_storage;
+	for (int i = 0; i < kRegions; i ++) {
+		fences[i] = nullptr;
+	}
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	release();
+}
+
+void* StreamBuffer::map(size_t size)
+{
+	if (buffer == 0 || size > region_size) {
+		// Grow geometrically so that a growing flock reallocates rarely.
+		size_t new_size = region_size > 0 ? 2 * region_size : kMinimumRegionSize;
+		allocate(size > new_size ? size : new_size);
+	}
+
+	if (!persistent_mapping) {
+		// Orphan the previous storage and map a fresh one.
+		void* data = nullptr;
+		CHECK_GL_ERROR(glBindBuffer(target, buffer));
+		CHECK_GL_ERROR(glBufferData(target, region_size, nullptr, GL_STREAM_DRAW));
+		CHECK_GL_ERROR(data = glMapBufferRange(target, 0, region_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+		return data;
+	}
+
+	// Move on to the next region, waiting until the GPU is done with it.
+	region = (region + 1) % kRegions;
+	if (fences[region] != nullptr) {
+		GLenum status = glClientWaitSync(fences[region], 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			stalls ++;
+			while (status == GL_TIMEOUT_EXPIRED) {
+				status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			}
+		}
+		glDeleteSync(fences[region]);
+		fences[region] = nullptr;
+	}
+	return mapped + region * region_size;
+}
+
+size_t StreamBuffer::unmap()
+{
+	CHECK_GL_ERROR(glBindBuffer(target, buffer));
+	if (!persistent_mapping) {
+		CHECK_GL_ERROR(glUnmapBuffer(target));
+		return 0;
+	}
+
+	// The mapping is coherent: writes are visible to the GPU without a flush.
+	return region * region_size;
+}
+
+void StreamBuffer::fence()
+{
+	if (persistent_mapping) {
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+void StreamBuffer::allocate(size_t size)
+{
+	// Immutable storage cannot be resized, so a new buffer replaces the old one.
+	// Draw calls already issued keep the old storage alive until they finish.
+	release();
+	region_size = size;
+
+	CHECK_GL_ERROR(glGenBuffers(1, &buffer));
+	CHECK_GL_ERROR(glBindBuffer(target, buffer));
+	if (persistent_mapping) {
+		CHECK_GL_ERROR(glBufferStorage(target, kRegions * region_size, nullptr, kPersistentFlags));
+		CHECK_GL_ERROR(mapped = (char*) glMapBufferRange(target, 0, kRegions * region_size, kPersistentFlags));
+	} else {
+		CHECK_GL_ERROR(glBufferData(target, region_size, nullptr, GL_STREAM_DRAW));
+	}
+}
+
+void StreamBuffer::release()
+{
+	for (int i = 0; i < kRegions; i ++) {
+		if (fences[i] != nullptr) {
+			glDeleteSync(fences[i]);
+			fences[i] = nullptr;
+		}
+	}
+
+	if (buffer != 0) {
+		if (mapped != nullptr) {
+			glBindBuffer(target, buffer);
+			glUnmapBuffer(target);
+			mapped = nullptr;
+		}
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+}
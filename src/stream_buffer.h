@@ -0,0 +1,58 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <GL/glew.h>
+#include <cstddef>
+
+// Buffer object for data that is rewritten every frame, such as the boid
+// instances. Instead of reallocating its storage with glBufferData every frame,
+// the buffer is split into kRegions regions that are written in turn: while the
+// CPU fills one region, the GPU may still be reading the previous ones. A fence
+// per region makes the CPU wait only when it gets a whole ring ahead of the GPU.
+//
+// With ARB_buffer_storage the buffer is mapped once, persistently, so data is
+// written straight into GPU-visible memory. Otherwise every frame orphans the
+// buffer and maps it again, which lets the driver hand out fresh storage
+// instead of waiting for the previous frame to be drawn.
+class StreamBuffer {
+public:
+	explicit StreamBuffer(GLenum target = GL_ARRAY_BUFFER);
+	~StreamBuffer();
+
+	// Method that returns memory where `size` bytes of this frame's data must
+	// be written, growing the buffer if needed.
+	void* map(size_t size);
+
+	// Method that hands the data written since map() over to the GPU. Returns
+	// the offset of that data within the buffer, which is left bound to its
+	// target so that vertex attribute pointers can be set to it.
+	size_t unmap();
+
+	// Method to call once the draw calls that read this frame's data have been
+	// issued, so that the region is not overwritten before they finish.
+	void fence();
+
+	GLuint id() const { return buffer; }
+	bool persistent() const { return persistent_mapping; }
+
+	// Number of times map() had to wait for the GPU to release a region.
+	unsigned long long stalls = 0;
+
+private:
+	static const int kRegions = 3;
+
+	void allocate(size_t size);
+	void release();
+
+	GLenum target;
+	bool persistent_mapping;
+	GLuint buffer = 0;
+	size_t region_size = 0;
+	int region = 0;
+
+	// Persistent mapping of the whole buffer (persistent mode only).
+	char* mapped = nullptr;
+	GLsync fences[kRegions];
+};
+
+#endif
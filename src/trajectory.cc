@@ -0,0 +1,374 @@
+#include "trajectory.h"
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+	const char kMagic[8] = { 'B', 'O', 'I', 'D', 'T', 'R', 'J', '\0' };
+	const uint32_t kVersion = 1;
+	const uint32_t kQuantized = 1;
+
+	// Ranges of the quantized values. Boids are steered back when they get
+	// 70 units away from the origin, and their speed is limited.
+	const float kPositionRange = 256.0f;
+	const float kVelocityRange = 8.0f;
+
+	// Number of values stored per Boid for positions, velocities and
+	// orientations, and where each array starts (in values per Boid).
+	const unsigned int kComponents[3] = { 3, 3, 4 };
+	const unsigned int kFieldStart[3] = { 0, 3, 6 };
+	const unsigned int kValuesPerBoid = 10;
+
+	int16_t quantize(float value, float range) {
+		float x = value / range;
+		x = x < -1.0f ? -1.0f : (x > 1.0f ? 1.0f : x);
+		return (int16_t) std::lround(x * 32767.0f);
+	}
+
+	size_t value_size(uint32_t flags) {
+		return (flags & kQuantized) ? sizeof(int16_t) : sizeof(float);
+	}
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+	close();
+}
+
+bool TrajectoryWriter::open(const std::string& path, bool quantize, const std::vector<glm::vec4>& obstacle_vertices,
+                            const std::vector<glm::uvec3>& obstacle_faces, size_t expected_frames,
+                            unsigned int expected_boids)
+{
+	file = std::fopen(path.c_str(), "wb");
+	if (file == nullptr) {
+		error_message = "cannot create " + path;
+		return false;
+	}
+
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.flags = quantize ? kQuantized : 0;
+	header.position_range = kPositionRange;
+	header.velocity_range = kVelocityRange;
+	header.obstacle_vertex_count = obstacle_vertices.size();
+	header.obstacle_face_count = obstacle_faces.size();
+
+	if (std::fwrite(&header, sizeof(header), 1, file) != 1 ||
+	    std::fwrite(obstacle_vertices.data(), sizeof(glm::vec4), obstacle_vertices.size(), file) !=
+	        obstacle_vertices.size() ||
+	    std::fwrite(obstacle_faces.data(), sizeof(glm::uvec3), obstacle_faces.size(), file) != obstacle_faces.size()) {
+		std::fclose(file);
+		file = nullptr;
+		failed = true;
+		error_message = "cannot write to " + path;
+		return false;
+	}
+	offset = sizeof(header) + sizeof(glm::vec4) * obstacle_vertices.size() + sizeof(glm::uvec3) * obstacle_faces.size();
+
+	closing = false;
+	failed = false;
+	// Reserve the bookkeeping of the background thread up front, so that it
+	// does not allocate while the simulation runs. At most kMaxQueued frames
+	// are queued, one is being written and one filled, so that many buffers
+	// are ever in use.
+	frame_offsets.clear();
+	frame_offsets.reserve(expected_frames);
+	queued.reserve(kMaxQueued);
+	free_buffers.resize(kMaxQueued + 2);
+	for (std::vector<char>& buffer : free_buffers) {
+		buffer.reserve(sizeof(TrajectoryFrame) + (size_t) kValuesPerBoid * expected_boids * value_size(header.flags));
+	}
+	thread = std::thread(&TrajectoryWriter::run, this);
+	return true;
+}
+
+void TrajectoryWriter::write_frame(uint64_t step, const FlockStorage& flock)
+{
+	if (file == nullptr) {
+		return;
+	}
+
+	// Take a spare buffer, waiting if the disk is too far behind.
+	std::vector<char> buffer;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [&]() { return queued.size() < kMaxQueued; });
+		if (!free_buffers.empty()) {
+			buffer.swap(free_buffers.back());
+			free_buffers.pop_back();
+		}
+	}
+
+	unsigned int n = flock.size();
+	size_t values = (size_t) kValuesPerBoid * n;
+	buffer.resize(sizeof(TrajectoryFrame) + values * value_size(header.flags));
+
+	TrajectoryFrame frame;
+	frame.step = step;
+	frame.boid_count = n;
+	frame.reserved = 0;
+	std::memcpy(buffer.data(), &frame, sizeof(frame));
+
+	char* out = buffer.data() + sizeof(frame);
+	if (header.flags & kQuantized) {
+		int16_t* q = (int16_t*) out;
+		for (unsigned int i = 0; i < n; i ++) {
+			for (int c = 0; c < 3; c ++) {
+				q[3 * i + c] = quantize(flock.position[i][c], header.position_range);
+				q[3 * n + 3 * i + c] = quantize(flock.velocity[i][c], header.velocity_range);
+			}
+			const glm::quat& o = flock.orientation[i];
+			q[6 * n + 4 * i + 0] = quantize(o.x, 1.0f);
+			q[6 * n + 4 * i + 1] = quantize(o.y, 1.0f);
+			q[6 * n + 4 * i + 2] = quantize(o.z, 1.0f);
+			q[6 * n + 4 * i + 3] = quantize(o.w, 1.0f);
+		}
+	} else {
+		float* f = (float*) out;
+		for (unsigned int i = 0; i < n; i ++) {
+			for (int c = 0; c < 3; c ++) {
+				f[3 * i + c] = flock.position[i][c];
+				f[3 * n + 3 * i + c] = flock.velocity[i][c];
+			}
+			const glm::quat& o = flock.orientation[i];
+			f[6 * n + 4 * i + 0] = o.x;
+			f[6 * n + 4 * i + 1] = o.y;
+			f[6 * n + 4 * i + 2] = o.z;
+			f[6 * n + 4 * i + 3] = o.w;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	queued.push_back(std::move(buffer));
+	changed.notify_all();
+}
+
+bool TrajectoryWriter::close()
+{
+	if (file == nullptr) {
+		return !failed;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+		changed.notify_all();
+	}
+	thread.join();
+
+	// Frame index, then the final header.
+	header.frame_count = frame_offsets.size();
+	header.index_offset = offset;
+	if (std::fwrite(frame_offsets.data(), sizeof(uint64_t), frame_offsets.size(), file) != frame_offsets.size() ||
+	    std::fseek(file, 0, SEEK_SET) != 0 ||
+	    std::fwrite(&header, sizeof(header), 1, file) != 1) {
+		failed = true;
+	}
+	if (std::fclose(file) != 0) {
+		failed = true;
+	}
+	file = nullptr;
+	if (failed && error_message.empty()) {
+		error_message = "could not write the trajectory";
+	}
+	return !failed;
+}
+
+void TrajectoryWriter::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		changed.wait(lock, [&]() { return closing || !queued.empty(); });
+		if (queued.empty()) {
+			return;
+		}
+		std::vector<char> buffer;
+		buffer.swap(queued.front());
+		queued.erase(queued.begin());
+		lock.unlock();
+
+		if (std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+			failed = true;
+		}
+		frame_offsets.push_back(offset);
+		offset += buffer.size();
+
+		lock.lock();
+		free_buffers.push_back(std::move(buffer));
+		changed.notify_all();
+	}
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+	close();
+}
+
+bool TrajectoryReader::open(const std::string& path)
+{
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		error_message = "cannot open " + path;
+		return false;
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0 || (size_t) status.st_size < sizeof(TrajectoryHeader)) {
+		::close(fd);
+		error_message = path + " is not a trajectory file";
+		return false;
+	}
+	size = status.st_size;
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		error_message = "cannot map " + path;
+		return false;
+	}
+	data = (const char*) mapping;
+
+	std::memcpy(&header, data, sizeof(header));
+	size_t geometry_end = sizeof(header) + sizeof(glm::vec4) * (size_t) header.obstacle_vertex_count +
+	                      sizeof(glm::uvec3) * (size_t) header.obstacle_face_count;
+	if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+		error_message = path + " is not a trajectory file";
+	} else if (header.version != kVersion) {
+		error_message = path + " has an unsupported version";
+	} else if (geometry_end > size || header.index_offset < geometry_end || header.index_offset > size ||
+	           header.frame_count > (size - header.index_offset) / sizeof(uint64_t)) {
+		error_message = path + " is truncated or was not closed";
+	}
+	if (!error_message.empty()) {
+		close();
+		return false;
+	}
+	index = data + header.index_offset;
+
+	// Every frame must lie between the geometry and the index.
+	for (size_t f = 0; f < header.frame_count; f ++) {
+		TrajectoryFrame frame;
+		uint64_t start = frame_offset(f);
+		if (start < geometry_end || start > header.index_offset - sizeof(frame)) {
+			error_message = path + " has a corrupt frame index";
+			close();
+			return false;
+		}
+		std::memcpy(&frame, data + start, sizeof(frame));
+		if (sizeof(frame) + (uint64_t) kValuesPerBoid * frame.boid_count * value_size(header.flags) >
+		    header.index_offset - start) {
+			error_message = path + " has a corrupt frame";
+			close();
+			return false;
+		}
+	}
+
+	vertices.resize(header.obstacle_vertex_count);
+	faces.resize(header.obstacle_face_count);
+	std::memcpy(vertices.data(), data + sizeof(header), sizeof(glm::vec4) * vertices.size());
+	std::memcpy(faces.data(), data + sizeof(header) + sizeof(glm::vec4) * vertices.size(),
+	            sizeof(glm::uvec3) * faces.size());
+	return true;
+}
+
+void TrajectoryReader::close()
+{
+	if (data != nullptr) {
+		munmap((void*) data, size);
+	}
+	data = nullptr;
+	size = 0;
+	index = nullptr;
+	header = TrajectoryHeader();
+}
+
+bool TrajectoryReader::quantized() const
+{
+	return (header.flags & kQuantized) != 0;
+}
+
+float TrajectoryReader::position_error() const
+{
+	// Each coordinate is off by at most half a quantization step.
+	return quantized() ? std::sqrt(3.0f) * 0.5f * header.position_range / 32767.0f : 0.0f;
+}
+
+size_t TrajectoryReader::frame_at(uint64_t step) const
+{
+	// Frames are recorded in step order.
+	size_t begin = 0, end = frame_count();
+	while (end - begin > 1) {
+		size_t middle = begin + (end - begin) / 2;
+		if (this->step(middle) <= step) {
+			begin = middle;
+		} else {
+			end = middle;
+		}
+	}
+	return begin;
+}
+
+uint64_t TrajectoryReader::frame_offset(size_t frame) const
+{
+	// The index follows the last frame, so it is only 4-byte aligned too.
+	uint64_t offset;
+	std::memcpy(&offset, index + sizeof(uint64_t) * frame, sizeof(offset));
+	return offset;
+}
+
+TrajectoryFrame TrajectoryReader::frame_header(size_t frame) const
+{
+	// Frames are only 4-byte aligned within the file.
+	TrajectoryFrame header;
+	std::memcpy(&header, data + frame_offset(frame), sizeof(header));
+	return header;
+}
+
+glm::vec4 TrajectoryReader::decode(size_t frame, unsigned int boid_count, int field, unsigned int i) const
+{
+	const char* values = data + frame_offset(frame) + sizeof(TrajectoryFrame);
+	size_t first = (size_t) kFieldStart[field] * boid_count + (size_t) kComponents[field] * i;
+	glm::vec4 v(0.0f, 0.0f, 0.0f, 0.0f);
+	if (quantized()) {
+		float range = field == 0 ? header.position_range : (field == 1 ? header.velocity_range : 1.0f);
+		int16_t q[4];
+		std::memcpy(q, values + first * sizeof(int16_t), kComponents[field] * sizeof(int16_t));
+		for (unsigned int c = 0; c < kComponents[field]; c ++) {
+			v[c] = q[c] * range / 32767.0f;
+		}
+	} else {
+		std::memcpy(&v[0], values + first * sizeof(float), kComponents[field] * sizeof(float));
+	}
+	return v;
+}
+
+glm::quat TrajectoryReader::decode_orientation(size_t frame, unsigned int boid_count, unsigned int i) const
+{
+	glm::vec4 o = decode(frame, boid_count, 2, i);
+	glm::quat q(o.w, o.x, o.y, o.z);
+	return quantized() ? glm::normalize(q) : q;
+}
+
+void TrajectoryReader::read_frame(size_t frame, FlockStorage& flock) const
+{
+	unsigned int n = boid_count(frame);
+	flock.position.resize(n);
+	flock.velocity.resize(n);
+	flock.orientation.resize(n);
+	for (unsigned int i = 0; i < n; i ++) {
+		flock.position[i] = glm::vec3(decode(frame, n, 0, i));
+		flock.velocity[i] = glm::vec3(decode(frame, n, 1, i));
+		flock.orientation[i] = decode_orientation(frame, n, i);
+	}
+}
+
+void TrajectoryReader::read_instances(size_t frame, BoidInstance* instances) const
+{
+	unsigned int n = boid_count(frame);
+	for (unsigned int i = 0; i < n; i ++) {
+		instances[i].position = glm::vec3(decode(frame, n, 0, i));
+		instances[i].orientation = decode_orientation(frame, n, i);
+	}
+}
@@ -0,0 +1,154 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "flock_storage.h"
+
+// Binary trajectory files: the state of the flock at a sequence of steps, so a
+// run can be replayed or compared without simulating it again.
+//
+// Layout (native little-endian):
+//   TrajectoryHeader
+//   obstacle geometry: vertices (4 floats each), faces (3 uint32 each)
+//   frames, each a TrajectoryFrame followed by the flock as arrays:
+//     positions (3 values per Boid), velocities (3), orientations (4: x, y, z, w)
+//     as floats, or as int16 when the file is quantized
+//   frame index: the file offset of every frame (uint64 each)
+//
+// Quantized files store positions and velocities as fractions of the ranges
+// in the header, and orientations as normalized int16, halving their size.
+// The header is rewritten when the file is closed; a file whose writer did not
+// finish has no frames.
+struct TrajectoryHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+	float position_range;
+	float velocity_range;
+	uint64_t frame_count;
+	uint64_t index_offset;
+	uint32_t obstacle_vertex_count;
+	uint32_t obstacle_face_count;
+};
+
+struct TrajectoryFrame {
+	uint64_t step;
+	uint32_t boid_count;
+	uint32_t reserved;
+};
+
+// Streams frames to a trajectory file. Frames are encoded on the calling
+// thread and written by a background thread, so the simulation only waits for
+// the disk when it gets several frames ahead of it.
+class TrajectoryWriter {
+public:
+	TrajectoryWriter() {}
+	~TrajectoryWriter();
+
+	// Method that creates the file and writes the header and the obstacle
+	// geometry. `expected_frames` and `expected_boids` are hints of how many
+	// frames will be written and how many Boids they hold, so that the writer
+	// can allocate its buffers up front. Returns false if the file cannot be
+	// created.
+	bool open(const std::string& path, bool quantize, const std::vector<glm::vec4>& obstacle_vertices,
+	          const std::vector<glm::uvec3>& obstacle_faces, size_t expected_frames = 0,
+	          unsigned int expected_boids = 0);
+
+	// Method that appends the state of the flock after the given step.
+	void write_frame(uint64_t step, const FlockStorage& flock);
+
+	// Method that writes the pending frames and the frame index. Returns
+	// whether everything was written.
+	bool close();
+
+	const std::string& error() const { return error_message; }
+
+private:
+	// Method run by the background thread.
+	void run();
+
+	static const size_t kMaxQueued = 4;
+
+	FILE* file = nullptr;
+	TrajectoryHeader header;
+	std::string error_message;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable changed;
+	// Frames waiting to be written, oldest first. At most kMaxQueued of them,
+	// so the array never grows.
+	std::vector<std::vector<char>> queued;
+	std::vector<std::vector<char>> free_buffers;
+	bool closing = false;
+	bool failed = false;
+
+	// Only touched by the background thread until it finishes.
+	uint64_t offset = 0;
+	std::vector<uint64_t> frame_offsets;
+};
+
+// Reads a trajectory file through a memory mapping. Any frame can be decoded
+// directly, in any order, through the frame index.
+class TrajectoryReader {
+public:
+	TrajectoryReader() {}
+	~TrajectoryReader();
+
+	// Method that maps the file and checks its header and index. Returns false
+	// (see error()) if it is not a complete trajectory file.
+	bool open(const std::string& path);
+	void close();
+
+	size_t frame_count() const { return header.frame_count; }
+	bool quantized() const;
+
+	// Largest distance between a decoded position and the recorded one, due to
+	// quantization.
+	float position_error() const;
+
+	// Step after which the given frame was recorded.
+	uint64_t step(size_t frame) const { return frame_header(frame).step; }
+
+	// Method that returns the last frame recorded after the given step or
+	// before it, or the first frame if all of them come later.
+	size_t frame_at(uint64_t step) const;
+	unsigned int boid_count(size_t frame) const { return frame_header(frame).boid_count; }
+
+	// Methods that decode the given frame into a flock, or into the instances
+	// to draw it with (boid_count(frame) of them).
+	void read_frame(size_t frame, FlockStorage& flock) const;
+	void read_instances(size_t frame, BoidInstance* instances) const;
+
+	const std::vector<glm::vec4>& obstacle_vertices() const { return vertices; }
+	const std::vector<glm::uvec3>& obstacle_faces() const { return faces; }
+
+	const std::string& error() const { return error_message; }
+
+private:
+	// Method that returns where the given frame starts in the file.
+	uint64_t frame_offset(size_t frame) const;
+	TrajectoryFrame frame_header(size_t frame) const;
+
+	// Method that decodes the position (index 0), velocity (1) or orientation
+	// (2) of Boid i of the given frame.
+	glm::vec4 decode(size_t frame, unsigned int boid_count, int field, unsigned int i) const;
+	glm::quat decode_orientation(size_t frame, unsigned int boid_count, unsigned int i) const;
+
+	const char* data = nullptr;
+	size_t size = 0;
+	TrajectoryHeader header = TrajectoryHeader();
+	const char* index = nullptr;
+	std::vector<glm::vec4> vertices;
+	std::vector<glm::uvec3> faces;
+	std::string error_message;
+};
+
+#endif
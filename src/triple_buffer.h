@@ -0,0 +1,49 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Lock-free triple buffer handing values from one writer thread to one reader
+// thread. The writer fills the back slot and publishes it; the reader takes
+// the most recently published slot. Neither side ever waits for the other: the
+// writer always has a free slot to fill, and the reader keeps the slot it took
+// until it asks for a newer one. Values published while the reader was busy
+// are overwritten, so the reader always sees the latest one.
+template <typename T>
+class TripleBuffer {
+public:
+	// Writer side: slot to fill before the next publish().
+	T& back() { return slots[back_index]; }
+
+	// Method that makes the back slot the latest value, and gives the writer
+	// the slot that held the previous one.
+	void publish() {
+		back_index = ready.exchange(back_index | kFresh, std::memory_order_acq_rel) & kIndexMask;
+	}
+
+	// Reader side: method that takes the latest published value, if it is newer
+	// than the one returned by front(). Returns whether it was.
+	bool acquire() {
+		if ((ready.load(std::memory_order_relaxed) & kFresh) == 0) {
+			return false;
+		}
+		front_index = ready.exchange(front_index, std::memory_order_acq_rel) & kIndexMask;
+		return true;
+	}
+
+	// Reader side: value taken by the last acquire().
+	const T& front() const { return slots[front_index]; }
+
+private:
+	// The ready slot is stored together with a flag telling whether it was
+	// published after the reader last took one.
+	static const unsigned int kIndexMask = 3;
+	static const unsigned int kFresh = 4;
+
+	T slots[3];
+	std::atomic<unsigned int> ready{1};
+	unsigned int back_index = 0;
+	unsigned int front_index = 2;
+};
+
+#endif